@@ -0,0 +1,37 @@
+#include "allocation_counter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<uint64_t> heapAllocationCount(0);
+
+uint64_t
+GetHeapAllocationCount()
+{
+  return heapAllocationCount.load(std::memory_order_relaxed);
+}
+
+// the array and nothrow forms forward to these by default
+void*
+operator new(size_t size)
+{
+  heapAllocationCount.fetch_add(1, std::memory_order_relaxed);
+
+  void* p = malloc(size > 0 ? size : 1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void
+operator delete(void* p) noexcept
+{
+  free(p);
+}
+
+void
+operator delete(void* p, size_t) noexcept
+{
+  free(p);
+}
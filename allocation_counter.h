@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstdint>
+
+// number of heap allocations made through the global operator new so far.
+// allocation_counter.cpp replaces the global allocation functions to count
+// them, benchmarks read the count around code that must not allocate
+uint64_t
+GetHeapAllocationCount();
@@ -0,0 +1,381 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+#include "allocation_counter.h"
+#include "contour_transform.h"
+#include "job_system.h"
+#include "tessellation_cache.h"
+
+static const uint32_t BENCH_GRID_SIZE = 48;
+
+static void
+drawGlyphGrid(Renderer& renderer, const std::vector<uint32_t>& geometryIds)
+{
+  const float cell = 2.f / BENCH_GRID_SIZE;
+  const float scale = 0.45f * cell;
+
+  uint32_t i = 0;
+  for (uint32_t y = 0; y < BENCH_GRID_SIZE; ++y) {
+    for (uint32_t x = 0; x < BENCH_GRID_SIZE; ++x) {
+      glm::vec2 offset(-1.f + (x + 0.5f) * cell, -1.f + (y + 0.5f) * cell);
+      renderer.drawGlyph(geometryIds[i++ % geometryIds.size()],
+                         { offset, { scale, scale } });
+    }
+  }
+}
+
+// average cpu and gpu milliseconds per frame of the glyph grid
+static void
+measureFrames(Window* window,
+              Renderer& renderer,
+              const std::vector<uint32_t>& geometryIds,
+              uint32_t frameCount,
+              double* cpuTime,
+              double* gpuTime)
+{
+  // warm up so pipelines and driver state are settled
+  for (uint32_t i = 0; i < 16; ++i) {
+    if (window)
+      window->Update();
+    drawGlyphGrid(renderer, geometryIds);
+    renderer.drawFrame();
+  }
+
+  double gpuTotal = 0.0;
+  auto start = std::chrono::steady_clock::now();
+
+  for (uint32_t i = 0; i < frameCount; ++i) {
+    if (window)
+      window->Update();
+    drawGlyphGrid(renderer, geometryIds);
+    renderer.drawFrame();
+    gpuTotal += renderer.GetGpuFrameTime();
+  }
+
+  std::chrono::duration<double, std::milli> cpuTotal =
+    std::chrono::steady_clock::now() - start;
+
+  *cpuTime = cpuTotal.count() / frameCount;
+  *gpuTime = gpuTotal / frameCount;
+}
+
+void
+runFanModeBenchmark(Window* window,
+                    Renderer& renderer,
+                    const std::vector<uint32_t>& geometryIds,
+                    uint32_t frameCount)
+{
+  struct
+  {
+    Renderer::FanMode mode;
+    const char* name;
+  } modes[] = { { Renderer::FAN_MODE_TRIANGLE_FAN, "triangle fans" },
+                { Renderer::FAN_MODE_TRIANGLE_LIST, "indexed lists" } };
+
+  if (geometryIds.empty())
+    return;
+
+  printf("%u glyph instances per frame, %u frames per mode\n",
+         BENCH_GRID_SIZE * BENCH_GRID_SIZE,
+         frameCount);
+
+  for (const auto& mode : modes) {
+    renderer.fanMode = mode.mode;
+
+    double cpuTime, gpuTime;
+    measureFrames(
+      window, renderer, geometryIds, frameCount, &cpuTime, &gpuTime);
+
+    printf("%-14s cpu %.3f ms/frame, gpu %.3f ms/frame\n",
+           mode.name,
+           cpuTime,
+           gpuTime);
+  }
+
+  renderer.printBufferStats();
+}
+
+void
+runSampleCountBenchmark(Window* window,
+                        Renderer& renderer,
+                        const std::vector<uint32_t>& geometryIds,
+                        uint32_t frameCount)
+{
+  struct
+  {
+    VkSampleCountFlagBits samples;
+    bool shading;
+  } modes[] = { { VK_SAMPLE_COUNT_1_BIT, false },
+                { VK_SAMPLE_COUNT_4_BIT, false },
+                { VK_SAMPLE_COUNT_4_BIT, true },
+                { VK_SAMPLE_COUNT_8_BIT, false },
+                { VK_SAMPLE_COUNT_8_BIT, true } };
+
+  if (geometryIds.empty())
+    return;
+
+  VkSampleCountFlagBits prevSamples = renderer.getSampleCount();
+  bool prevShading = renderer.getSampleShading();
+  bool prevAnalytic = renderer.getAnalyticCoverage();
+
+  renderer.setAnalyticCoverage(false);
+  for (const auto& mode : modes) {
+    renderer.setSampleCount(mode.samples, mode.shading);
+
+    // unsupported modes fall back, report what actually ran
+    if (renderer.getSampleCount() != mode.samples ||
+        renderer.getSampleShading() != mode.shading)
+      continue;
+
+    double cpuTime, gpuTime;
+    measureFrames(
+      window, renderer, geometryIds, frameCount, &cpuTime, &gpuTime);
+
+    printf("%ux msaa%-16s cpu %.3f ms/frame, gpu %.3f ms/frame\n",
+           (uint32_t)mode.samples,
+           mode.shading ? " sample shading" : "",
+           cpuTime,
+           gpuTime);
+  }
+
+  renderer.setAnalyticCoverage(true);
+  double cpuTime, gpuTime;
+  measureFrames(window, renderer, geometryIds, frameCount, &cpuTime, &gpuTime);
+  printf("1x analytic coverage    cpu %.3f ms/frame, gpu %.3f ms/frame\n",
+         cpuTime,
+         gpuTime);
+
+  renderer.setAnalyticCoverage(prevAnalytic);
+  renderer.setSampleCount(prevSamples, prevShading);
+}
+
+void
+runContourTransformBenchmark(const std::vector<GlyphView>& glyphs,
+                             uint32_t iterationCount)
+{
+  typedef void (*Kernel)(
+    const int16_t*, uint32_t, const ContourTransform&, Renderer::Segment*);
+  struct
+  {
+    Kernel function;
+    const char* name;
+  } kernels[] = { { transformContourScalar, "scalar" },
+                  { transformContour, "simd" } };
+
+  // one contour at a time goes through the output, like in the
+  // tessellation cache
+  uint64_t pointCount = 0;
+  uint32_t maxSegmentCount = 0;
+  for (const auto& glyph : glyphs) {
+    for (uint32_t i = 0; i < glyph.contourCount; ++i) {
+      uint32_t segmentCount = getContourSegmentCount(glyph.contours[i].count);
+      if (segmentCount == 0)
+        continue;
+      pointCount += glyph.contours[i].count / 2;
+      maxSegmentCount = std::max(maxSegmentCount, segmentCount);
+    }
+  }
+
+  if (pointCount == 0)
+    return;
+
+  std::vector<Renderer::Segment> segments(maxSegmentCount);
+
+  printf("contour transform, %zu glyphs, %llu points, %u iterations\n",
+         glyphs.size(),
+         (unsigned long long)pointCount,
+         iterationCount);
+
+  for (const auto& kernel : kernels) {
+    float checksum = 0.f;
+    auto start = std::chrono::steady_clock::now();
+
+    for (uint32_t n = 0; n < iterationCount; ++n) {
+      for (const auto& glyph : glyphs) {
+        ContourTransform transform = getContourTransform(glyph.xMin,
+                                                         glyph.yMin,
+                                                         glyph.xMax,
+                                                         glyph.yMax,
+                                                         glyph.pointScale,
+                                                         1.f);
+
+        for (uint32_t i = 0; i < glyph.contourCount; ++i) {
+          uint32_t count = glyph.contours[i].count;
+          if (getContourSegmentCount(count) == 0)
+            continue;
+          kernel.function(
+            glyph.GetContourPoints(i), count, transform, segments.data());
+          checksum += segments[0].p0.x;
+        }
+      }
+    }
+
+    std::chrono::duration<double> time =
+      std::chrono::steady_clock::now() - start;
+
+    // the checksum keeps the stores alive
+    printf("%-6s %.1f Mpoints/s (checksum %g)\n",
+           kernel.name,
+           pointCount * iterationCount / time.count() * 1e-6,
+           checksum);
+  }
+}
+
+void
+runTessellationBenchmark(const std::vector<GlyphView>& glyphs,
+                         uint32_t iterationCount,
+                         uint32_t maxThreadCount)
+{
+  if (glyphs.empty())
+    return;
+
+  printf("tessellation, %zu glyphs, %u iterations\n",
+         glyphs.size(),
+         iterationCount);
+
+  std::vector<TessellatedGlyph> tessellated(glyphs.size());
+
+  for (uint32_t threadCount = 1;; threadCount *= 2) {
+    threadCount = std::min(threadCount, maxThreadCount);
+    JobSystem jobs(threadCount - 1);
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (uint32_t n = 0; n < iterationCount; ++n) {
+      jobs.ParallelFor(static_cast<uint32_t>(glyphs.size()),
+                       16,
+                       [&glyphs, &tessellated](uint32_t first, uint32_t last) {
+                         for (uint32_t i = first; i < last; ++i) {
+                           tessellated[i] = {};
+                           tessellateGlyph(glyphs[i], tessellated[i]);
+                         }
+                       });
+    }
+
+    std::chrono::duration<double> time =
+      std::chrono::steady_clock::now() - start;
+
+    printf("%2u threads %.1f kglyphs/s\n",
+           threadCount,
+           glyphs.size() * iterationCount / time.count() * 1e-3);
+
+    if (threadCount == maxThreadCount)
+      break;
+  }
+}
+
+// the glyph grid as pushed geometry, every contour goes through
+// writeContour into the vertex ring
+static void
+pushGlyphGrid(Renderer& renderer, const std::vector<GlyphView>& glyphs)
+{
+  const uint32_t gridSize = 16;
+  const float cell = 2.f / gridSize;
+  const float scale = 0.45f * cell;
+
+  uint32_t i = 0;
+  for (uint32_t y = 0; y < gridSize; ++y) {
+    for (uint32_t x = 0; x < gridSize; ++x) {
+      const GlyphView& glyph = glyphs[i++ % glyphs.size()];
+      glm::vec2 offset(-1.f + (x + 0.5f) * cell, -1.f + (y + 0.5f) * cell);
+
+      // placement folded into the normalization
+      ContourTransform transform = getContourTransform(glyph.xMin,
+                                                       glyph.yMin,
+                                                       glyph.xMax,
+                                                       glyph.yMax,
+                                                       glyph.pointScale,
+                                                       scale);
+      transform.offset += offset;
+
+      for (uint32_t c = 0; c < glyph.contourCount; ++c) {
+        uint32_t count = glyph.contours[c].count;
+        if (getContourSegmentCount(count) == 0)
+          continue;
+
+        Renderer::ContourRenderSpan contour = renderer.allocateContour(
+          getContourSegmentCount(count), getContourFanCount(count));
+        writeContour(
+          glyph.GetContourPoints(c), count, transform, 0.f, contour);
+        renderer.pushSegments(contour);
+        renderer.pushFan(contour);
+      }
+    }
+  }
+}
+
+void
+runPushedContourBenchmark(Window* window,
+                          Renderer& renderer,
+                          const std::vector<GlyphView>& glyphs,
+                          uint32_t frameCount)
+{
+  if (glyphs.empty())
+    return;
+
+  // rings grow to their steady state size while warming up
+  for (uint32_t i = 0; i < 16; ++i) {
+    if (window)
+      window->Update();
+    pushGlyphGrid(renderer, glyphs);
+    renderer.drawFrame();
+  }
+
+  uint64_t allocationCount = GetHeapAllocationCount();
+  auto start = std::chrono::steady_clock::now();
+
+  for (uint32_t i = 0; i < frameCount; ++i) {
+    if (window)
+      window->Update();
+    pushGlyphGrid(renderer, glyphs);
+    renderer.drawFrame();
+  }
+
+  std::chrono::duration<double, std::milli> cpuTotal =
+    std::chrono::steady_clock::now() - start;
+  allocationCount = GetHeapAllocationCount() - allocationCount;
+
+  printf("pushed contours cpu %.3f ms/frame, %llu heap allocations\n",
+         cpuTotal.count() / frameCount,
+         (unsigned long long)allocationCount);
+  ASSERT_TRUE(allocationCount == 0);
+}
+
+void
+writeGlyphGridImage(Renderer& renderer,
+                    const std::vector<uint32_t>& geometryIds,
+                    const char* file)
+{
+  if (geometryIds.empty())
+    return;
+
+  drawGlyphGrid(renderer, geometryIds);
+  renderer.drawFrame();
+
+  std::vector<uint8_t> pixels;
+  renderer.readFrame(pixels);
+
+  FILE* out = fopen(file, "wb");
+  ASSERT_TRUE(out != nullptr);
+
+  // binary ppm, the frame is BGRA8
+  uint32_t width = renderer.swapchain->imageExtent.width;
+  uint32_t height = renderer.swapchain->imageExtent.height;
+  fprintf(out, "P6\n%u %u\n255\n", width, height);
+
+  std::vector<uint8_t> row(3 * width);
+  for (uint32_t y = 0; y < height; ++y) {
+    const uint8_t* src = &pixels[4 * width * y];
+    for (uint32_t x = 0; x < width; ++x) {
+      row[3 * x + 0] = src[4 * x + 2];
+      row[3 * x + 1] = src[4 * x + 1];
+      row[3 * x + 2] = src[4 * x + 0];
+    }
+    fwrite(row.data(), 1, row.size(), out);
+  }
+
+  fclose(out);
+}
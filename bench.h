@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+
+#include "glyphs.h"
+#include "renderer.h"
+#include "window.h"
+
+// draws a grid of instances of the given resident glyphs for frameCount
+// frames per fan mode and prints the average cpu and gpu frame times.
+// window is nullptr for a headless renderer
+void
+runFanModeBenchmark(Window* window,
+                    Renderer& renderer,
+                    const std::vector<uint32_t>& geometryIds,
+                    uint32_t frameCount);
+
+// same grid for every supported sample count, with and without sample
+// shading, and with analytic coverage. modes the device does not support
+// are skipped
+void
+runSampleCountBenchmark(Window* window,
+                        Renderer& renderer,
+                        const std::vector<uint32_t>& geometryIds,
+                        uint32_t frameCount);
+
+// transforms the contours of all glyphs iterationCount times with the scalar
+// and the simd kernel and prints points per second for both. cpu only
+void
+runContourTransformBenchmark(const std::vector<GlyphView>& glyphs,
+                             uint32_t iterationCount);
+
+// tessellates all glyphs iterationCount times on job systems with one
+// thread up to maxThreadCount threads, doubling in between, and prints
+// glyphs per second for each. cpu only
+void
+runTessellationBenchmark(const std::vector<GlyphView>& glyphs,
+                         uint32_t iterationCount,
+                         uint32_t maxThreadCount);
+
+// pushes the contours of a grid of glyphs every frame, written in place
+// into the vertex ring, and prints the cpu frame time. asserts that frames
+// after the warm up make no heap allocations
+void
+runPushedContourBenchmark(Window* window,
+                          Renderer& renderer,
+                          const std::vector<GlyphView>& glyphs,
+                          uint32_t frameCount);
+
+// draws the same grid once on a headless renderer and writes the frame to
+// file as binary ppm
+void
+writeGlyphGridImage(Renderer& renderer,
+                    const std::vector<uint32_t>& geometryIds,
+                    const char* file);
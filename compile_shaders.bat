@@ -1,4 +1,4 @@
 echo off
 mkdir build
-for %%x in (preSegment.vert preSegment.frag preFan.vert preFan.frag post.vert post.frag) do tools\glslangValidator.exe -V res\shaders\%%x -o build\%%x.spv"
+for %%x in (preSegment.vert preGlyphSegment.vert preSegment.frag preFan.vert preFan.frag post.vert post.frag preSegmentCoverage.frag postCoverage.frag) do tools\glslangValidator.exe -V res\shaders\%%x -o build\%%x.spv"
 pause
\ No newline at end of file
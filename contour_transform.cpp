@@ -0,0 +1,128 @@
+#include "contour_transform.h"
+
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                  \
+  (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CONTOUR_TRANSFORM_SSE
+#include <emmintrin.h>
+
+// the four low / high int16 lanes sign extended and converted, sse2 has no
+// pmovsx
+static inline __m128
+lowInt16ToFloat(__m128i v)
+{
+  return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+}
+
+static inline __m128
+highInt16ToFloat(__m128i v)
+{
+  return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+}
+#endif
+
+// the kernels write segments as 6 consecutive floats
+static_assert(sizeof(Renderer::Segment) == 6 * sizeof(float),
+              "segment is not tightly packed");
+
+ContourTransform
+getContourTransform(float xMin,
+                    float yMin,
+                    float xMax,
+                    float yMax,
+                    float pointScale,
+                    float scale)
+{
+  // glyphs without an outline, e.g. a space, have no box to normalize to
+  if (!(xMax > xMin) || !(yMax > yMin))
+    return { { 0.f, 0.f }, { 0.f, 0.f } };
+
+  // (2 * (x - xMin) / (xMax - xMin) - 1) * scale for x in font units,
+  // negated for y
+  float sx = 2.f * scale / (xMax - xMin);
+  float sy = 2.f * scale / (yMax - yMin);
+
+  return { { sx * pointScale, -sy * pointScale },
+           { -sx * xMin - scale, sy * yMin + scale } };
+}
+
+void
+transformContourScalar(const int16_t* points,
+                       uint32_t count,
+                       const ContourTransform& transform,
+                       Renderer::Segment* segments)
+{
+  const glm::vec2 scale = transform.scale;
+  const glm::vec2 offset = transform.offset;
+  const uint32_t segmentCount = getContourSegmentCount(count);
+
+  for (uint32_t i = 0; i < segmentCount; ++i) {
+    const int16_t* p = points + 4 * i;
+    segments[i] = { glm::vec2(p[0], p[1]) * scale + offset,
+                    glm::vec2(p[2], p[3]) * scale + offset,
+                    glm::vec2(p[4], p[5]) * scale + offset };
+  }
+}
+
+void
+transformContour(const int16_t* points,
+                 uint32_t count,
+                 const ContourTransform& transform,
+                 Renderer::Segment* segments)
+{
+#ifdef CONTOUR_TRANSFORM_SSE
+  const __m128 scale = _mm_setr_ps(transform.scale.x,
+                                   transform.scale.y,
+                                   transform.scale.x,
+                                   transform.scale.y);
+  const __m128 offset = _mm_setr_ps(transform.offset.x,
+                                    transform.offset.y,
+                                    transform.offset.x,
+                                    transform.offset.y);
+
+  const uint32_t segmentCount = getContourSegmentCount(count);
+  float* out = reinterpret_cast<float*>(segments);
+  uint32_t i = 0;
+
+  // two segments share their middle point, so a pair is five points in and
+  // twelve floats out
+  for (; i + 2 <= segmentCount; i += 2, out += 12) {
+    const int16_t* p = points + 4 * i;
+
+    int32_t p4;
+    memcpy(&p4, p + 8, sizeof(p4));
+    __m128i v16 = _mm_loadu_si128((const __m128i*)p);
+    __m128i w16 = _mm_cvtsi32_si128(p4);
+
+    // a = (p0, p1), b = (p2, p3), c = (p4, -)
+    __m128 a = _mm_add_ps(_mm_mul_ps(lowInt16ToFloat(v16), scale), offset);
+    __m128 b = _mm_add_ps(_mm_mul_ps(highInt16ToFloat(v16), scale), offset);
+    __m128 c = _mm_add_ps(_mm_mul_ps(lowInt16ToFloat(w16), scale), offset);
+
+    // (p0, p1, p2), (p2, p3, p4)
+    _mm_storeu_ps(out, a);
+    _mm_storeu_ps(out + 4, _mm_movelh_ps(b, b));
+    _mm_storeu_ps(out + 8, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 0, 3, 2)));
+  }
+
+  // odd last segment
+  if (i < segmentCount) {
+    const int16_t* p = points + 4 * i;
+
+    // a = (p0, p1), b = (p2, -)
+    int32_t p2;
+    memcpy(&p2, p + 4, sizeof(p2));
+    __m128i a16 = _mm_loadl_epi64((const __m128i*)p);
+    __m128i b16 = _mm_cvtsi32_si128(p2);
+
+    __m128 a = _mm_add_ps(_mm_mul_ps(lowInt16ToFloat(a16), scale), offset);
+    __m128 b = _mm_add_ps(_mm_mul_ps(lowInt16ToFloat(b16), scale), offset);
+
+    _mm_storeu_ps(out, a);
+    _mm_storel_pi((__m64*)(out + 4), b);
+  }
+#else
+  transformContourScalar(points, count, transform, segments);
+#endif
+}
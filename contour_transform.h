@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+
+#include "renderer.h"
+
+// per axis affine map p' = scale * p + offset from stored glyph points to
+// normalized glyph space, i.e. the glyph bounding box mapped to [-1, 1] and
+// scaled, with y pointing down. an empty box maps everything to the origin
+struct ContourTransform
+{
+  glm::vec2 scale;
+  glm::vec2 offset;
+};
+
+ContourTransform
+getContourTransform(float xMin,
+                    float yMin,
+                    float xMax,
+                    float yMax,
+                    float pointScale,
+                    float scale);
+
+// segments of a contour of count coordinates, see ContourRange
+inline uint32_t
+getContourSegmentCount(uint32_t count)
+{
+  return count < 6 ? 0 : (count - 2) / 4;
+}
+
+// transforms the control points of a contour and writes its
+// getContourSegmentCount(count) segments. uses sse where the target has it,
+// two segments per iteration since they share a point, otherwise the scalar
+// kernel
+void
+transformContour(const int16_t* points,
+                 uint32_t count,
+                 const ContourTransform& transform,
+                 Renderer::Segment* segments);
+
+// plain c++ reference of transformContour
+void
+transformContourScalar(const int16_t* points,
+                       uint32_t count,
+                       const ContourTransform& transform,
+                       Renderer::Segment* segments);
@@ -0,0 +1,176 @@
+#include "device_memory_allocator.h"
+
+#include "vk_utils.h"
+
+DeviceMemoryAllocator::DeviceMemoryAllocator(
+  VkDevice device,
+  const VkPhysicalDeviceMemoryProperties& memProps,
+  VkDeviceSize blockSize)
+  : device(device)
+  , memProps(memProps)
+  , blockSize(blockSize)
+{}
+
+DeviceMemoryAllocator::~DeviceMemoryAllocator()
+{
+  for (uint32_t i = 0; i < blocks.size(); ++i) {
+    if (blocks[i])
+      DestroyBlock(i);
+  }
+}
+
+uint32_t
+DeviceMemoryAllocator::CreateBlock(uint32_t memoryTypeIdx,
+                                   VkDeviceSize size,
+                                   bool linear,
+                                   bool dedicated)
+{
+  Block* block = new Block{ vkuAllocateMemory(device, size, memoryTypeIdx),
+                            memoryTypeIdx,
+                            linear,
+                            dedicated,
+                            nullptr,
+                            0,
+                            RangeAllocator(size) };
+  ASSERT_VK_VALID_HANDLE(block->memory);
+
+  if (memProps.memoryTypes[memoryTypeIdx].propertyFlags &
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+    ASSERT_VK_SUCCESS(vkMapMemory(
+      device, block->memory, 0, VK_WHOLE_SIZE, 0, (void**)&block->mapped));
+  }
+
+  // reuse the slot of a released block
+  for (uint32_t i = 0; i < blocks.size(); ++i) {
+    if (!blocks[i]) {
+      blocks[i] = block;
+      return i;
+    }
+  }
+
+  blocks.push_back(block);
+  return static_cast<uint32_t>(blocks.size()) - 1;
+}
+
+void
+DeviceMemoryAllocator::DestroyBlock(uint32_t blockIdx)
+{
+  // freeing implicitly unmaps
+  vkFreeMemory(device, blocks[blockIdx]->memory, nullptr);
+  delete blocks[blockIdx];
+  blocks[blockIdx] = nullptr;
+}
+
+DeviceAllocation
+DeviceMemoryAllocator::Allocate(const VkMemoryRequirements& requirements,
+                                VkMemoryPropertyFlags propertyFlags,
+                                bool linear)
+{
+  uint32_t memoryTypeIdx =
+    findMemoryTypeIdx(requirements, memProps, propertyFlags);
+
+  // lazily allocated memory is a hint for transient attachments, most
+  // desktop devices do not have it
+  bool lazy = propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+  if (memoryTypeIdx == (uint32_t)-1 && lazy) {
+    lazy = false;
+    memoryTypeIdx = findMemoryTypeIdx(
+      requirements,
+      memProps,
+      propertyFlags & ~VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+  }
+  ASSERT_TRUE(memoryTypeIdx != (uint32_t)-1);
+
+  uint32_t blockIdx = (uint32_t)-1;
+  uint64_t offset = 0;
+
+  // lazily allocated blocks are committed on use, they are never shared
+  bool dedicated = lazy || requirements.size > blockSize / 2;
+
+  if (!dedicated) {
+    for (uint32_t i = 0; i < blocks.size(); ++i) {
+      Block* block = blocks[i];
+      if (block && !block->dedicated &&
+          block->memoryTypeIdx == memoryTypeIdx && block->linear == linear &&
+          block->ranges.Allocate(
+            requirements.size, requirements.alignment, &offset)) {
+        blockIdx = i;
+        break;
+      }
+    }
+  }
+
+  if (blockIdx == (uint32_t)-1) {
+    blockIdx = CreateBlock(memoryTypeIdx,
+                           dedicated ? requirements.size : blockSize,
+                           linear,
+                           dedicated);
+
+    // fresh block, everything is free
+    ASSERT_TRUE(blocks[blockIdx]->ranges.Allocate(
+      requirements.size, requirements.alignment, &offset));
+  }
+
+  Block* block = blocks[blockIdx];
+
+  ++block->allocationCount;
+  ++allocationCount;
+  usedBytes += requirements.size;
+
+  DeviceAllocation allocation;
+  allocation.memory = block->memory;
+  allocation.offset = offset;
+  allocation.size = requirements.size;
+  allocation.mapped = block->mapped ? block->mapped + offset : nullptr;
+  allocation.blockIdx = blockIdx;
+  return allocation;
+}
+
+void
+DeviceMemoryAllocator::Free(const DeviceAllocation& allocation)
+{
+  if (allocation.memory == VK_NULL_HANDLE)
+    return;
+
+  Block* block = blocks[allocation.blockIdx];
+  ASSERT_TRUE(block && block->memory == allocation.memory);
+
+  block->ranges.Free(allocation.offset, allocation.size);
+  --block->allocationCount;
+  --allocationCount;
+  usedBytes -= allocation.size;
+
+  if (block->allocationCount > 0)
+    return;
+
+  // one empty block per memory type is kept around for reuse
+  bool keep = !block->dedicated;
+  for (uint32_t i = 0; keep && i < blocks.size(); ++i) {
+    if (i != allocation.blockIdx && blocks[i] && !blocks[i]->dedicated &&
+        blocks[i]->memoryTypeIdx == block->memoryTypeIdx &&
+        blocks[i]->linear == block->linear &&
+        blocks[i]->allocationCount == 0) {
+      keep = false;
+    }
+  }
+
+  if (!keep)
+    DestroyBlock(allocation.blockIdx);
+}
+
+DeviceMemoryAllocator::Stats
+DeviceMemoryAllocator::GetStats() const
+{
+  Stats stats = {};
+  for (const Block* block : blocks) {
+    if (block) {
+      ++stats.blockCount;
+      stats.reservedBytes += block->ranges.GetSize();
+    }
+  }
+
+  stats.allocationCount = allocationCount;
+  stats.usedBytes = usedBytes;
+  stats.wastedBytes = stats.reservedBytes - usedBytes;
+  return stats;
+}
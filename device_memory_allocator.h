@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+#include "range_allocator.h"
+
+// range of a device memory block, resources are bound at offset
+struct DeviceAllocation
+{
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  VkDeviceSize offset = 0;
+  VkDeviceSize size = 0;
+  uint8_t* mapped = nullptr; // host visible memory stays mapped
+  uint32_t blockIdx = 0;
+};
+
+// suballocates large device memory blocks per memory type instead of one
+// vkAllocateMemory per resource. linear resources (buffers) and optimal
+// tiling images never share a block, so bufferImageGranularity can not be
+// violated. allocations bigger than half a block get a block of their own.
+struct DeviceMemoryAllocator
+{
+  DeviceMemoryAllocator(VkDevice device,
+                        const VkPhysicalDeviceMemoryProperties& memProps,
+                        VkDeviceSize blockSize = 1024 * 1024 * 64);
+
+  DeviceMemoryAllocator() = delete;
+  DeviceMemoryAllocator(const DeviceMemoryAllocator&) = delete;
+  DeviceMemoryAllocator& operator=(const DeviceMemoryAllocator& other) = delete;
+
+  ~DeviceMemoryAllocator();
+
+  DeviceAllocation Allocate(const VkMemoryRequirements& requirements,
+                            VkMemoryPropertyFlags propertyFlags,
+                            bool linear);
+  void Free(const DeviceAllocation& allocation);
+
+  VkDevice GetDevice() const { return device; }
+
+  struct Stats
+  {
+    uint32_t blockCount;
+    uint32_t allocationCount;
+    VkDeviceSize reservedBytes; // allocated from the driver
+    VkDeviceSize usedBytes;     // handed out to resources
+    VkDeviceSize wastedBytes;   // reserved but not used
+  };
+
+  Stats GetStats() const;
+
+private:
+  VkDevice device;
+  VkPhysicalDeviceMemoryProperties memProps;
+  VkDeviceSize blockSize;
+
+  struct Block
+  {
+    VkDeviceMemory memory;
+    uint32_t memoryTypeIdx;
+    bool linear;
+    bool dedicated;
+    uint8_t* mapped;
+    uint32_t allocationCount;
+    RangeAllocator ranges;
+  };
+
+  std::vector<Block*> blocks; // null for released blocks
+  VkDeviceSize usedBytes = 0;
+  uint32_t allocationCount = 0;
+
+  uint32_t CreateBlock(uint32_t memoryTypeIdx,
+                       VkDeviceSize size,
+                       bool linear,
+                       bool dedicated);
+  void DestroyBlock(uint32_t blockIdx);
+};
@@ -0,0 +1,116 @@
+#include "frame_ring_buffer.h"
+
+#include <cstring>
+
+#include "vk_utils.h"
+
+// keeps slots aligned for every buffer usage
+static const VkDeviceSize FRAME_ALIGNMENT = 256;
+
+static VkDeviceSize
+alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+FrameRingBuffer::FrameRingBuffer(
+  VkDevice device,
+  DeviceMemoryAllocator* allocator,
+  VkBufferUsageFlags usage,
+  VkDeviceSize frameSize,
+  uint32_t frameCount)
+  : device(device)
+  , allocator(allocator)
+  , usage(usage)
+  , frameCount(frameCount)
+{
+  ASSERT_TRUE(frameCount > 0);
+  CreateBuffer(alignUp(frameSize, FRAME_ALIGNMENT));
+}
+
+FrameRingBuffer::~FrameRingBuffer()
+{
+  for (const auto& r : retired) {
+    vkDestroyBuffer(device, r.buffer, nullptr);
+    allocator->Free(r.memory);
+  }
+
+  vkDestroyBuffer(device, buffer, nullptr);
+  allocator->Free(memory);
+}
+
+void
+FrameRingBuffer::CreateBuffer(VkDeviceSize size)
+{
+  frameSize = size;
+
+  buffer = vkuCreateBuffer(
+    device, frameSize * frameCount, usage, VK_SHARING_MODE_EXCLUSIVE, {});
+
+  memory = vkuAllocateBufferMemory(
+    device,
+    allocator,
+    buffer,
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+    true);
+  mapped = memory.mapped;
+
+  frameOffset = (frameNumber % frameCount) * frameSize;
+}
+
+VkDeviceSize
+FrameRingBuffer::Allocate(VkDeviceSize size, VkDeviceSize alignment)
+{
+  VkDeviceSize offset = alignUp(frameUsed, alignment);
+  if (offset + size > frameSize) {
+    Grow(offset + size);
+  }
+
+  frameUsed = offset + size;
+  if (frameUsed > highWaterMark)
+    highWaterMark = frameUsed;
+
+  return offset;
+}
+
+void
+FrameRingBuffer::Grow(VkDeviceSize minFrameSize)
+{
+  VkDeviceSize newFrameSize = frameSize * 2;
+  if (newFrameSize < minFrameSize)
+    newFrameSize = alignUp(minFrameSize, FRAME_ALIGNMENT);
+
+  // frames before the current one keep reading the old buffer, it goes
+  // away once the last of them left the ring
+  RetiredBuffer old = { buffer, memory, frameNumber };
+  const uint8_t* oldFrame = mapped + frameOffset;
+
+  CreateBuffer(newFrameSize);
+
+  // what the current frame allocated so far moves along
+  memcpy(mapped + frameOffset, oldFrame, frameUsed);
+
+  retired.push_back(old);
+  ++growCount;
+}
+
+void
+FrameRingBuffer::NextFrame()
+{
+  ++frameNumber;
+  frameOffset = (frameNumber % frameCount) * frameSize;
+  frameUsed = 0;
+
+  // the caller waited for frame frameNumber - frameCount, and with it for
+  // every earlier frame
+  for (size_t i = 0; i < retired.size();) {
+    if (retired[i].retireFrame + frameCount <= frameNumber + 1) {
+      vkDestroyBuffer(device, retired[i].buffer, nullptr);
+      allocator->Free(retired[i].memory);
+      retired[i] = retired.back();
+      retired.pop_back();
+    } else {
+      ++i;
+    }
+  }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+#include "device_memory_allocator.h"
+
+// persistently mapped buffer split into one slot per frame in flight. every
+// frame allocates linearly from its own slot, offsets are relative to the
+// slot so they stay valid when the buffer grows mid frame. a slot is only
+// reused after NextFrame was called frameCount times, the caller has to make
+// sure the gpu is done with the frame that used it before.
+struct FrameRingBuffer
+{
+  FrameRingBuffer(VkDevice device,
+                  DeviceMemoryAllocator* allocator,
+                  VkBufferUsageFlags usage,
+                  VkDeviceSize frameSize,
+                  uint32_t frameCount);
+
+  FrameRingBuffer() = delete;
+  FrameRingBuffer(const FrameRingBuffer&) = delete;
+  FrameRingBuffer& operator=(const FrameRingBuffer& other) = delete;
+
+  ~FrameRingBuffer();
+
+  // grows the buffer if the current slot is full, pointers returned by
+  // GetPointer before are invalidated then
+  VkDeviceSize Allocate(VkDeviceSize size, VkDeviceSize alignment);
+  void* GetPointer(VkDeviceSize offset)
+  {
+    return mapped + frameOffset + offset;
+  }
+
+  VkBuffer GetBuffer() const { return buffer; }
+  VkDeviceSize GetFrameOffset() const { return frameOffset; }
+  VkDeviceSize GetFrameUsed() const { return frameUsed; }
+  VkDeviceSize GetFrameSize() const { return frameSize; }
+
+  // most bytes a single frame has allocated so far
+  VkDeviceSize GetHighWaterMark() const { return highWaterMark; }
+  uint32_t GetGrowCount() const { return growCount; }
+
+  void NextFrame();
+
+private:
+  VkDevice device;
+  DeviceMemoryAllocator* allocator;
+  VkBufferUsageFlags usage;
+  uint32_t frameCount;
+
+  VkBuffer buffer = VK_NULL_HANDLE;
+  DeviceAllocation memory;
+  uint8_t* mapped = nullptr;
+  VkDeviceSize frameSize = 0;
+
+  uint64_t frameNumber = 0;
+  VkDeviceSize frameOffset = 0;
+  VkDeviceSize frameUsed = 0;
+
+  VkDeviceSize highWaterMark = 0;
+  uint32_t growCount = 0;
+
+  // buffers replaced by a bigger one, still read by frames before
+  // retireFrame
+  struct RetiredBuffer
+  {
+    VkBuffer buffer;
+    DeviceAllocation memory;
+    uint64_t retireFrame;
+  };
+  std::vector<RetiredBuffer> retired;
+
+  void CreateBuffer(VkDeviceSize frameSize);
+  void Grow(VkDeviceSize minFrameSize);
+};
@@ -0,0 +1,217 @@
+#include "glyph_pack.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include "vk_utils.h"
+
+static bool
+sectionInBounds(uint64_t offset, uint64_t size, uint64_t fileSize)
+{
+  return offset % 4 == 0 && offset <= fileSize && size <= fileSize - offset;
+}
+
+bool
+GlyphPack::Open(const char* filename)
+{
+  Close();
+
+  if (!file.Open(filename))
+    return false;
+
+  if (file.size < sizeof(Header)) {
+    Close();
+    return false;
+  }
+
+  const Header* h = reinterpret_cast<const Header*>(file.data);
+
+  if (h->magic != MAGIC || h->version != VERSION ||
+      !sectionInBounds(h->glyphsOffset,
+                       uint64_t(h->glyphCount) * sizeof(GlyphEntry),
+                       file.size) ||
+      !sectionInBounds(h->contoursOffset,
+                       uint64_t(h->contourCount) * sizeof(ContourRange),
+                       file.size) ||
+      !sectionInBounds(h->pointsOffset,
+                       uint64_t(h->pointCount) * 2 * sizeof(int16_t),
+                       file.size) ||
+      !sectionInBounds(h->namesOffset, h->namesSize, file.size) ||
+      (h->namesSize > 0 && file.data[h->namesOffset + h->namesSize - 1])) {
+    Close();
+    return false;
+  }
+
+  header = h;
+  glyphEntries =
+    reinterpret_cast<const GlyphEntry*>(file.data + h->glyphsOffset);
+  contourRanges =
+    reinterpret_cast<const ContourRange*>(file.data + h->contoursOffset);
+  points = reinterpret_cast<const int16_t*>(file.data + h->pointsOffset);
+  names = reinterpret_cast<const char*>(file.data + h->namesOffset);
+
+  if (!entriesInBounds()) {
+    Close();
+    return false;
+  }
+
+  return true;
+}
+
+bool
+GlyphPack::entriesInBounds() const
+{
+  // glyphs and contours are used in place, every range they refer to is
+  // checked once here instead of on access
+  for (uint32_t i = 0; i < header->glyphCount; ++i) {
+    const GlyphEntry& entry = glyphEntries[i];
+    if (entry.firstContour > header->contourCount ||
+        entry.contourCount > header->contourCount - entry.firstContour ||
+        entry.nameOffset >= header->namesSize || !(entry.pointScale > 0.f)) {
+      return false;
+    }
+  }
+
+  uint64_t coordinateCount = uint64_t(header->pointCount) * 2;
+  for (uint32_t i = 0; i < header->contourCount; ++i) {
+    const ContourRange& range = contourRanges[i];
+    if (range.first > coordinateCount ||
+        range.count > coordinateCount - range.first) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void
+GlyphPack::Close()
+{
+  file.Close();
+  header = nullptr;
+  glyphEntries = nullptr;
+  contourRanges = nullptr;
+  points = nullptr;
+  names = nullptr;
+}
+
+GlyphView
+GlyphPack::GetGlyph(uint32_t idx) const
+{
+  ASSERT_TRUE(idx < header->glyphCount);
+
+  const GlyphEntry& entry = glyphEntries[idx];
+
+  ASSERT_TRUE(entry.firstContour <= header->contourCount &&
+              entry.contourCount <= header->contourCount - entry.firstContour);
+  ASSERT_TRUE(entry.nameOffset < header->namesSize);
+
+  return { names + entry.nameOffset,
+           entry.xMin,
+           entry.yMin,
+           entry.xMax,
+           entry.yMax,
+           entry.pointScale,
+           points,
+           contourRanges + entry.firstContour,
+           entry.contourCount };
+}
+
+bool
+GlyphPack::FindGlyph(const char* name, uint32_t* idx) const
+{
+  for (uint32_t i = 0; i < GetGlyphCount(); ++i) {
+    if (strcmp(names + glyphEntries[i].nameOffset, name) == 0) {
+      *idx = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+static uint32_t
+alignUp(uint32_t value)
+{
+  return (value + 3) & ~3u;
+}
+
+bool
+GlyphPack::Write(const char* filename, const std::vector<Glyph>& glyphs)
+{
+  std::vector<GlyphEntry> glyphEntries;
+  std::vector<ContourRange> contourRanges;
+  std::vector<int16_t> pointPool;
+  std::vector<float> glyphPoints;
+  std::vector<char> nameTable;
+
+  for (const auto& glyph : glyphs) {
+    GlyphEntry entry = {};
+    entry.nameOffset = static_cast<uint32_t>(nameTable.size());
+    entry.xMin = glyph.xMin;
+    entry.yMin = glyph.yMin;
+    entry.xMax = glyph.xMax;
+    entry.yMax = glyph.yMax;
+    entry.firstContour = static_cast<uint32_t>(contourRanges.size());
+    entry.contourCount = static_cast<uint32_t>(glyph.contours.size());
+    glyphEntries.push_back(entry);
+
+    const char* name = glyph.name ? glyph.name : "";
+    nameTable.insert(nameTable.end(), name, name + strlen(name) + 1);
+
+    // one unit for all contours of a glyph
+    glyphPoints.clear();
+    for (const auto& contour : glyph.contours) {
+      contourRanges.push_back(
+        { static_cast<uint32_t>(pointPool.size() + glyphPoints.size()),
+          static_cast<uint32_t>(contour.size()) });
+      glyphPoints.insert(glyphPoints.end(), contour.begin(), contour.end());
+    }
+
+    size_t first = pointPool.size();
+    pointPool.resize(first + glyphPoints.size());
+
+    glyphEntries.back().pointScale =
+      QuantizeGlyphPoints(glyphPoints.data(),
+                          static_cast<uint32_t>(glyphPoints.size()),
+                          pointPool.data() + first,
+                          nullptr);
+  }
+
+  Header h = {};
+  h.magic = MAGIC;
+  h.version = VERSION;
+  h.glyphCount = static_cast<uint32_t>(glyphEntries.size());
+  h.contourCount = static_cast<uint32_t>(contourRanges.size());
+  h.pointCount = static_cast<uint32_t>(pointPool.size() / 2);
+  h.glyphsOffset = alignUp(sizeof(Header));
+  h.contoursOffset =
+    alignUp(h.glyphsOffset + h.glyphCount * sizeof(GlyphEntry));
+  h.pointsOffset =
+    alignUp(h.contoursOffset + h.contourCount * sizeof(ContourRange));
+  h.namesOffset = alignUp(
+    h.pointsOffset +
+    static_cast<uint32_t>(pointPool.size() * sizeof(int16_t)));
+  h.namesSize = static_cast<uint32_t>(nameTable.size());
+
+  std::vector<uint8_t> buff(h.namesOffset + h.namesSize, 0);
+  memcpy(buff.data(), &h, sizeof(h));
+  memcpy(buff.data() + h.glyphsOffset,
+         glyphEntries.data(),
+         glyphEntries.size() * sizeof(GlyphEntry));
+  memcpy(buff.data() + h.contoursOffset,
+         contourRanges.data(),
+         contourRanges.size() * sizeof(ContourRange));
+  memcpy(buff.data() + h.pointsOffset,
+         pointPool.data(),
+         pointPool.size() * sizeof(int16_t));
+  memcpy(buff.data() + h.namesOffset, nameTable.data(), nameTable.size());
+
+  FILE* file = fopen(filename, "wb");
+  if (!file)
+    return false;
+
+  size_t written = fwrite(buff.data(), 1, buff.size(), file);
+  fclose(file);
+
+  return written == buff.size();
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "glyphs.h"
+#include "mapped_file.h"
+
+// versioned on-disk glyph pack, mapped and used in place:
+//
+//   Header
+//   GlyphEntry[glyphCount]
+//   ContourRange[contourCount]  (ranges into the point pool, in int16)
+//   int16_t[pointCount * 2]     (point pool, see QuantizeGlyphPoints)
+//   char[]                      (zero terminated glyph names)
+//
+// section offsets are in bytes from the start of the file, all sections are
+// 4 byte aligned.
+struct GlyphPack
+{
+  static const uint32_t MAGIC = 0x4b504c47; // "GLPK"
+  static const uint32_t VERSION = 2;
+
+  struct Header
+  {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t glyphCount;
+    uint32_t contourCount;
+    uint32_t pointCount;
+    uint32_t glyphsOffset;
+    uint32_t contoursOffset;
+    uint32_t pointsOffset;
+    uint32_t namesOffset;
+    uint32_t namesSize;
+  };
+
+  struct GlyphEntry
+  {
+    uint32_t nameOffset; // relative to namesOffset
+    float xMin, yMin, xMax, yMax;
+    float pointScale; // font units per point pool unit
+    uint32_t firstContour;
+    uint32_t contourCount;
+  };
+
+  GlyphPack() = default;
+  GlyphPack(const GlyphPack&) = delete;
+  GlyphPack& operator=(const GlyphPack&) = delete;
+
+  // maps the pack and validates the header, the section bounds and the
+  // ranges of every glyph and contour once, false for a corrupt pack
+  bool Open(const char* filename);
+  void Close();
+  bool IsOpen() const { return header != nullptr; }
+
+  uint32_t GetGlyphCount() const { return header ? header->glyphCount : 0; }
+  GlyphView GetGlyph(uint32_t idx) const;
+  bool FindGlyph(const char* name, uint32_t* idx) const;
+
+  // coordinates are quantized per glyph with QuantizeGlyphPoints
+  static bool Write(const char* filename, const std::vector<Glyph>& glyphs);
+
+private:
+  MappedFile file;
+  const Header* header = nullptr;
+  const GlyphEntry* glyphEntries = nullptr;
+  const ContourRange* contourRanges = nullptr;
+  const int16_t* points = nullptr;
+  const char* names = nullptr;
+
+  // contour, point and name ranges of all entries lie within their sections
+  bool entriesInBounds() const;
+};
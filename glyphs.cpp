@@ -1,10 +1,45 @@
 #include "glyphs.h"
 
+#include <cmath>
+
+float
+QuantizeGlyphPoints(const float* points,
+                    uint32_t count,
+                    int16_t* quantized,
+                    bool* exact)
+{
+  float maxAbs = 0.f;
+  for (uint32_t i = 0; i < count; ++i) {
+    maxAbs = std::fmax(maxAbs, std::fabs(points[i]));
+  }
+
+  // halve the resolution until the largest coordinate fits
+  float pointScale = .5f;
+  while (maxAbs / pointScale > 32767.f) {
+    pointScale *= 2.f;
+  }
+
+  bool allExact = true;
+  for (uint32_t i = 0; i < count; ++i) {
+    float value = std::round(points[i] / pointScale);
+    quantized[i] = static_cast<int16_t>(value);
+    allExact = allExact && value * pointScale == points[i];
+  }
+
+  if (exact)
+    *exact = allExact;
+
+  return pointScale;
+}
+
 // uncomment & recompile for roboto glyphs
 // #define ROBOTO_GLYPHS
 
 #ifndef ROBOTO_GLYPHS
-std::vector<Glyph> glyphs = {
+std::vector<Glyph>
+BuiltinGlyphs()
+{
+  return {
   { "A",
     0.0f,
     -140.0f,
@@ -5175,9 +5210,13 @@ std::vector<Glyph> glyphs = {
         465.0f, 480.0f, 465.0f,
       },
     } },
-};
+  };
+}
 #else
-std::vector<Glyph> glyphs = {
+std::vector<Glyph>
+BuiltinGlyphs()
+{
+  return {
   { ".notdef",
     100.0f,
     0.0f,
@@ -18330,5 +18369,6 @@ std::vector<Glyph> glyphs = {
         963.0f, 1456.0f,
       },
     } },
-};
+  };
+}
 #endif // !ROBOTO_GLYPHS
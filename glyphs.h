@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <vector>
 
 struct Glyph
@@ -8,4 +9,41 @@ struct Glyph
   std::vector<std::vector<float>> contours;
 };
 
-extern std::vector<Glyph> glyphs;
+// compiled-in glyph table, only used to bake a glyph pack
+std::vector<Glyph> BuiltinGlyphs();
+
+// contour as a range of coordinates into a point pool, laid out as
+// [p0, c, p1, c, p2, ...] with the first point repeated at the end
+struct ContourRange
+{
+  uint32_t first;
+  uint32_t count;
+};
+
+// stored outline coordinates are int16 in units of pointScale font units.
+// font outlines are integral in font units and the implied on-curve points
+// and line controls between them are halves, so half units keep them exact
+// for coordinates up to 16383 units. larger glyphs get coarser units.
+// converts count coordinates and returns the unit, exact (optional) tells
+// whether no coordinate was rounded
+float
+QuantizeGlyphPoints(const float* points,
+                    uint32_t count,
+                    int16_t* quantized,
+                    bool* exact);
+
+// non-owning view onto a glyph outline, bounds are in font units
+struct GlyphView
+{
+  const char* name;
+  float xMin, yMin, xMax, yMax;
+  float pointScale;
+  const int16_t* points;
+  const ContourRange* contours;
+  uint32_t contourCount;
+
+  const int16_t* GetContourPoints(uint32_t idx) const
+  {
+    return points + contours[idx].first;
+  }
+};
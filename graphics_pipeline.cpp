@@ -1,5 +1,7 @@
 #include "graphics_pipeline.h"
 
+#include <algorithm> // find
+
 GraphicsPipeline::~GraphicsPipeline()
 {
   vkDestroyPipeline(device, pipeline, nullptr);
@@ -24,12 +26,15 @@ GraphicsPipeline::Builder::Build()
   graphicsPipeline->descriptorSetLayouts.resize(DescriptorSetLayouts.size());
   uint32_t i = 0;
 
+  // the builder stays reusable, e.g. for variants of the same pipeline
+  std::vector<VkDescriptorSetLayout> layouts = SharedLayouts;
+
   for (auto bindings : DescriptorSetLayouts) {
     auto info = vkiDescriptorSetLayoutCreateInfo(
       static_cast<uint32_t>(bindings.size()), bindings.data());
     vkCreateDescriptorSetLayout(
       Device, &info, nullptr, &graphicsPipeline->descriptorSetLayouts[i]);
-    SharedLayouts.push_back(graphicsPipeline->descriptorSetLayouts[i]);
+    layouts.push_back(graphicsPipeline->descriptorSetLayouts[i]);
     ++i;
   }
 
@@ -37,8 +42,8 @@ GraphicsPipeline::Builder::Build()
   // PipelineLayout
   // --------------------------------------------------------------------------
   auto info = vkiPipelineLayoutCreateInfo(
-    static_cast<uint32_t>(SharedLayouts.size()),
-    SharedLayouts.data(),
+    static_cast<uint32_t>(layouts.size()),
+    layouts.data(),
     static_cast<uint32_t>(PushConstantRanges.size()),
     PushConstantRanges.data());
 
@@ -76,10 +81,23 @@ GraphicsPipeline::Builder::Build()
   PipelineColorBlendStateCreateInfo.blendConstants[2] = BlendConstants[2];
   PipelineColorBlendStateCreateInfo.blendConstants[3] = BlendConstants[3];
 
+  // dynamic viewports and scissors are set while recording, the pipeline
+  // only needs their count
+  auto isDynamic = [&](VkDynamicState state) {
+    return std::find(DynamicStates.begin(), DynamicStates.end(), state) !=
+           DynamicStates.end();
+  };
+  uint32_t viewportCount = static_cast<uint32_t>(Viewports.size());
+  if (viewportCount == 0 && isDynamic(VK_DYNAMIC_STATE_VIEWPORT))
+    viewportCount = 1;
+  uint32_t scissorCount = static_cast<uint32_t>(Scissors.size());
+  if (scissorCount == 0 && isDynamic(VK_DYNAMIC_STATE_SCISSOR))
+    scissorCount = 1;
+
   graphicsPipeline->pipeline = vkuCreateGraphicsPipeline(
     Device,
-    std::initializer_list<VkPipelineShaderStageCreateInfo>(
-      shaderStages.begin()._Ptr, shaderStages.end()._Ptr),
+    PipelineCache,
+    shaderStages,
     vkiPipelineVertexInputStateCreateInfo(
       static_cast<uint32_t>(VertexBindings.size()),
       VertexBindings.data(),
@@ -88,10 +106,12 @@ GraphicsPipeline::Builder::Build()
     vkiPipelineInputAssemblyStateCreateInfo(PrimitiveTopology,
                                             PrimitiveRestartEnable),
     vkiPipelineTessellationStateCreateInfo(PatchControlPoints),
-    vkiPipelineViewportStateCreateInfo(static_cast<uint32_t>(Viewports.size()),
-                                       Viewports.data(),
-                                       static_cast<uint32_t>(Scissors.size()),
-                                       Scissors.data()),
+    vkiPipelineViewportStateCreateInfo(viewportCount,
+                                       Viewports.empty() ? nullptr
+                                                         : Viewports.data(),
+                                       scissorCount,
+                                       Scissors.empty() ? nullptr
+                                                        : Scissors.data()),
     vkiPipelineRasterizationStateCreateInfo(DepthClampEnable,
                                             RasterizerDiscardEnable,
                                             PolygonMode,
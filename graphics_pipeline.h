@@ -1,7 +1,7 @@
 #pragma once
 
 #include <vector>
-#include <vulkan\vulkan_core.h>
+#include <vulkan/vulkan_core.h>
 
 #include "vk_init.h"
 #include "vk_utils.h"
@@ -29,6 +29,7 @@ private:
 struct GraphicsPipeline::Builder
 {
   VkDevice Device = VK_NULL_HANDLE;
+  VkPipelineCache PipelineCache = VK_NULL_HANDLE;
   VkShaderModule VertexShader = VK_NULL_HANDLE;
   VkShaderModule FragmentShader = VK_NULL_HANDLE;
   std::vector<VkDescriptorSetLayout> SharedLayouts{};
@@ -85,6 +86,7 @@ struct GraphicsPipeline::Builder
 	}
 
 		SETTER(VkDevice, Device)
+		SETTER(VkPipelineCache, PipelineCache)
 		SETTER(std::vector<VkDescriptorSetLayout>, SharedLayouts)
 		SETTER(std::vector<std::vector<VkDescriptorSetLayoutBinding>>, DescriptorSetLayouts)
 		SETTER(std::vector<VkPushConstantRange>, PushConstantRanges)
@@ -144,5 +146,5 @@ struct GraphicsPipeline::Builder
     return *this;
   }
 
-  GraphicsPipeline* Builder::Build();
+  GraphicsPipeline* Build();
 };
@@ -0,0 +1,120 @@
+#include "job_system.h"
+
+#include <algorithm>
+
+#include "vk_utils.h"
+
+JobSystem::JobSystem(uint32_t workerCount)
+  : queuedJobCount(0)
+{
+  for (uint32_t i = 0; i < workerCount + 1; ++i) {
+    queues.emplace_back(new Queue());
+  }
+
+  for (uint32_t i = 0; i < workerCount; ++i) {
+    workers.emplace_back(&JobSystem::workerLoop, this, i + 1);
+  }
+}
+
+JobSystem::~JobSystem()
+{
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    quit = true;
+  }
+  wake.notify_all();
+
+  for (auto& worker : workers) {
+    worker.join();
+  }
+}
+
+void
+JobSystem::ParallelFor(uint32_t count,
+                       uint32_t batchSize,
+                       const std::function<void(uint32_t, uint32_t)>& body)
+{
+  ASSERT_TRUE(batchSize > 0);
+
+  uint32_t batchCount = (count + batchSize - 1) / batchSize;
+  if (batchCount == 0)
+    return;
+
+  // the batches reference locals of this call, it does not return before
+  // the last of them finished
+  std::atomic<uint32_t> remaining(batchCount);
+
+  for (uint32_t i = 0; i < batchCount; ++i) {
+    uint32_t first = i * batchSize;
+    uint32_t last = std::min(first + batchSize, count);
+    push(i % GetThreadCount(), [&body, &remaining, first, last]() {
+      body(first, last);
+      remaining.fetch_sub(1, std::memory_order_release);
+    });
+  }
+
+  while (remaining.load(std::memory_order_acquire) > 0) {
+    if (!runJob(0))
+      std::this_thread::yield();
+  }
+}
+
+void
+JobSystem::push(uint32_t queueIdx, std::function<void()> job)
+{
+  {
+    std::lock_guard<std::mutex> lock(queues[queueIdx]->mutex);
+    queues[queueIdx]->jobs.push_back(std::move(job));
+  }
+  queuedJobCount.fetch_add(1);
+
+  // a worker checks the count under sleepMutex before it sleeps, so taking
+  // it here means the wakeup cannot get lost in between
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+  }
+  wake.notify_one();
+}
+
+bool
+JobSystem::runJob(uint32_t queueIdx)
+{
+  std::function<void()> job;
+
+  for (uint32_t i = 0; i < GetThreadCount() && !job; ++i) {
+    Queue& queue = *queues[(queueIdx + i) % GetThreadCount()];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.jobs.empty())
+      continue;
+
+    // newest job of the own queue, oldest of a stolen one
+    if (i == 0) {
+      job = std::move(queue.jobs.back());
+      queue.jobs.pop_back();
+    } else {
+      job = std::move(queue.jobs.front());
+      queue.jobs.pop_front();
+    }
+  }
+
+  if (!job)
+    return false;
+
+  queuedJobCount.fetch_sub(1);
+  job();
+  return true;
+}
+
+void
+JobSystem::workerLoop(uint32_t queueIdx)
+{
+  for (;;) {
+    if (runJob(queueIdx))
+      continue;
+
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    wake.wait(lock, [this]() { return quit || queuedJobCount.load() > 0; });
+    if (quit)
+      return;
+  }
+}
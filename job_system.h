@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// fixed pool of worker threads with one job queue each. a thread takes jobs
+// from the back of its own queue and steals from the front of the others
+// when it runs dry. the thread that submits work runs jobs too while it
+// waits, so a pool without workers runs everything inline.
+struct JobSystem
+{
+  JobSystem(uint32_t workerCount);
+
+  JobSystem() = delete;
+  JobSystem(const JobSystem&) = delete;
+  JobSystem& operator=(const JobSystem& other) = delete;
+
+  ~JobSystem();
+
+  // calls body(first, last) for consecutive ranges of at most batchSize
+  // indices covering [0, count) and returns once all of them finished.
+  // only to be called from the thread that created the job system
+  void ParallelFor(uint32_t count,
+                   uint32_t batchSize,
+                   const std::function<void(uint32_t, uint32_t)>& body);
+
+  // threads running jobs, including the submitting one
+  uint32_t GetThreadCount() const
+  {
+    return static_cast<uint32_t>(queues.size());
+  }
+
+private:
+  struct Queue
+  {
+    std::mutex mutex;
+    std::deque<std::function<void()>> jobs;
+  };
+
+  // queue 0 belongs to the submitting thread, queue i + 1 to worker i
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::vector<std::thread> workers;
+
+  // workers sleep while no queue has jobs
+  std::mutex sleepMutex;
+  std::condition_variable wake;
+  std::atomic<uint32_t> queuedJobCount;
+  bool quit = false;
+
+  void push(uint32_t queueIdx, std::function<void()> job);
+  // runs one job from the own queue or a stolen one, false if all are empty
+  bool runJob(uint32_t queueIdx);
+  void workerLoop(uint32_t queueIdx);
+};
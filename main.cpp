@@ -1,109 +1,193 @@
 // clang-format off
-#include <vulkan\vulkan_core.h>
-#include <GLFW\glfw3.h>
+#include <vulkan/vulkan_core.h>
+#include <GLFW/glfw3.h>
 // clang-format on
 
-#include <glm\gtx\transform.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <glm/gtx/transform.hpp>
 
 #include "window.h"
 #include "renderer.h"
+#include "bench.h"
 #include "clock.h"
-#include "glyphs.h"
-
-// aspect correction, scaling and y flipping of bezier control
-// points
-Renderer::ContourRenderObj
-contourToRenderObj(std::vector<float>& c,
-                   float xMin,
-                   float yMin,
-                   float xMax,
-                   float yMax,
-                   float z,
-                   float aspectRatio,
-                   float scale)
+#include "glyph_pack.h"
+#include "job_system.h"
+#include "tessellation_cache.h"
+#include "truetype_font.h"
+
+static const char* GLYPH_PACK_FILE = "glyphs.pack";
+static const char* GLYPH_IMAGE_FILE = "glyphs.ppm";
+
+int
+main(int argc, char** argv)
 {
-  for (int i = 0; i < c.size(); i += 2) {
-    c[i] = (2 * (c[i] - xMin) / (xMax - xMin) - 1) * scale;
-    c[i + 1] = (2 * (c[i + 1] - yMin) / (yMax - yMin) - 1) * scale;
-    c[i + 1] = -c[i + 1];
-  }
+  {
+    // optional .ttf on the command line, decoded lazily glyph by glyph.
+    // --bench compares the contour transform kernels and the fan modes
+    // instead of showing the glyphs.
+    // --headless renders offscreen without a window, and unless benching
+    // writes a single frame of the glyph grid to GLYPH_IMAGE_FILE.
+    // --msaa <samples> and --sample-shading select the anti-aliasing mode,
+    // --analytic-aa uses edge coverage instead. --nonzero fills with the
+    // nonzero winding rule instead of even-odd. --frames <n> sets the
+    // number of frames in flight, --timeline tracks them with a timeline
+    // semaphore instead of fences where supported
+    const char* fontFile = nullptr;
+    bool bench = false;
+    bool headless = false;
+    uint32_t samples = 1;
+    bool sampleShading = false;
+    bool analyticCoverage = false;
+    bool nonzero = false;
+    uint32_t framesInFlight = 2;
+    bool timeline = false;
+    for (int i = 1; i < argc; ++i) {
+      if (strcmp(argv[i], "--bench") == 0)
+        bench = true;
+      else if (strcmp(argv[i], "--headless") == 0)
+        headless = true;
+      else if (strcmp(argv[i], "--msaa") == 0 && i + 1 < argc)
+        samples = std::max(atoi(argv[++i]), 1);
+      else if (strcmp(argv[i], "--sample-shading") == 0)
+        sampleShading = true;
+      else if (strcmp(argv[i], "--analytic-aa") == 0)
+        analyticCoverage = true;
+      else if (strcmp(argv[i], "--nonzero") == 0)
+        nonzero = true;
+      else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        framesInFlight = std::max(atoi(argv[++i]), 1);
+      else if (strcmp(argv[i], "--timeline") == 0)
+        timeline = true;
+      else
+        fontFile = argv[i];
+    }
 
-  std::vector<Renderer::Segment> segments;
+    TrueTypeFont font;
+    bool useFont = fontFile && font.Open(fontFile);
 
-  for (int i = 0; i < c.size() - 5; i += 4) {
-    segments.push_back({ { c[i], c[i + 1], z },
-                         { 0.f, 0.f },
-                         { c[i + 2], c[i + 3], z },
-                         { .5f, 0.f },
-                         { c[i + 4], c[i + 5], z },
-                         { 1.f, 1.f } });
-  }
+    // bake the compiled-in glyph table on first run, afterwards the pack is
+    // mapped and used in place
+    GlyphPack glyphPack;
+    if (!useFont && !glyphPack.Open(GLYPH_PACK_FILE)) {
+      ASSERT_TRUE(GlyphPack::Write(GLYPH_PACK_FILE, BuiltinGlyphs()));
+      ASSERT_TRUE(glyphPack.Open(GLYPH_PACK_FILE));
+    }
 
-  std::vector<glm::vec3> fan;
+    Window* window = nullptr;
+    Renderer* renderer = nullptr;
+    if (headless) {
+      renderer =
+        new Renderer(VkExtent2D{ 1280, 920 }, framesInFlight, timeline);
+    } else {
+      window = new Window(1280, 920, "Quadratic Bezier Contours");
+      renderer = new Renderer(window, framesInFlight, timeline);
+    }
 
-  fan.push_back({ -1.f, -1.f, 0.f });
+    // cold start cost, a warm pipeline cache from the last run cuts it down
+    printf("pipelines built in %.3f ms\n", renderer->GetPipelineCreateTime());
 
-  for (auto seg : segments) {
-    fan.push_back(seg.p0);
-  }
+    renderer->setSampleCount(VkSampleCountFlagBits(samples), sampleShading);
+    if (analyticCoverage)
+      renderer->setAnalyticCoverage(true);
+    if (nonzero)
+      renderer->setFillRule(Renderer::FILL_RULE_NONZERO);
+    Clock clock = {};
 
-  fan.push_back(segments[0].p0);
+    TessellationCache tessellationCache(renderer);
+
+    uint32_t glyphCount =
+      useFont ? font.GetGlyphCount() : glyphPack.GetGlyphCount();
+
+    if (bench || headless) {
+      // the main thread runs jobs as well, the interactive loop tessellates
+      // one glyph at a time and spawns no workers
+      uint32_t threadCount =
+        std::max(std::thread::hardware_concurrency(), 1u);
+      JobSystem jobs(threadCount - 1);
+
+      // views are decoded up front, the font decodes lazily and is not
+      // thread safe
+      std::vector<uint32_t> glyphIds;
+      std::vector<GlyphView> glyphViews;
+      for (uint32_t i = 0; i < glyphCount && glyphIds.size() < 64; ++i) {
+        GlyphView glyph = useFont ? font.GetGlyph(i) : glyphPack.GetGlyph(i);
+        if (glyph.contourCount > 0) {
+          glyphIds.push_back(i);
+          glyphViews.push_back(glyph);
+        }
+      }
 
-  return { segments, fan };
-}
+      tessellationCache.Prefetch(jobs,
+                                 glyphIds.data(),
+                                 glyphViews.data(),
+                                 static_cast<uint32_t>(glyphIds.size()));
 
-int
-main()
-{
-  {
-    Window window(1280, 920, "Quadratic Bezier Contours");
-    Renderer renderer(&window);
-    Clock clock = {};
+      std::vector<uint32_t> geometryIds;
+      for (uint32_t i = 0; i < glyphIds.size(); ++i) {
+        geometryIds.push_back(
+          tessellationCache.Get(glyphIds[i], glyphViews[i]).geometryId);
+      }
 
-    std::vector<Renderer::ContourRenderObj> contourRenderObjs;
+      if (bench) {
+        std::vector<GlyphView> glyphs;
+        for (uint32_t i = 0; i < glyphCount; ++i) {
+          glyphs.push_back(useFont ? font.GetGlyph(i) : glyphPack.GetGlyph(i));
+        }
+        runContourTransformBenchmark(glyphs, 100);
+        runTessellationBenchmark(glyphs, 20, threadCount);
+
+        runPushedContourBenchmark(window, *renderer, glyphViews, 500);
+        runFanModeBenchmark(window, *renderer, geometryIds, 500);
+        runSampleCountBenchmark(window, *renderer, geometryIds, 500);
+      } else
+        writeGlyphGridImage(*renderer, geometryIds, GLYPH_IMAGE_FILE);
+
+      delete renderer;
+      delete window;
+      return 0;
+    }
 
     const float showTime = 1.f;
     float timePassed = 0.f;
     int glyphIdx = 0;
 
-    while (window.keyboardState.key[GLFW_KEY_ESCAPE] != 1) {
-      window.Update();
-      renderer.Update();
+    while (window->keyboardState.key[GLFW_KEY_ESCAPE] != 1) {
+      window->Update();
+      renderer->Update();
       clock.Update();
 
       timePassed += clock.GetTick();
 
       // select next glyph
       if (timePassed > showTime) {
-        glyphIdx = (glyphIdx + 1) % glyphs.size();
+        glyphIdx = (glyphIdx + 1) % glyphCount;
         timePassed = 0.f;
       }
 
-      contourRenderObjs.clear();
-
-      // tranform glyph data to render primitives (segments + triangle fans)
-      for (auto c : glyphs[glyphIdx].contours) {
-        contourRenderObjs.push_back(contourToRenderObj(
-          c,
-          glyphs[glyphIdx].xMin,
-          glyphs[glyphIdx].yMin,
-          glyphs[glyphIdx].xMax,
-          glyphs[glyphIdx].yMax,
-          0.f,
-          window.windowSize.width / (float)window.windowSize.height,
-          0.1f + 0.3f * timePassed / showTime));
-      }
+      GlyphView glyph =
+        useFont ? font.GetGlyph(glyphIdx) : glyphPack.GetGlyph(glyphIdx);
 
-      // hand renderable primitives to renderer (first all segments, then all
-      // fans)
-      for (auto& cro : contourRenderObjs)
-        renderer.pushSegments(cro.segments);
+      // contours are only tessellated and uploaded the first time a glyph
+      // is shown, afterwards only its placement is handed to the renderer.
+      // glyphs without contours show an empty frame
+      if (glyph.contourCount > 0) {
+        const TessellatedGlyph& tessellated =
+          tessellationCache.Get(glyphIdx, glyph);
 
-      for (auto& cro : contourRenderObjs)
-        renderer.pushFan(cro.fan);
+        float scale = 0.1f + 0.3f * timePassed / showTime;
+        renderer->drawGlyph(tessellated.geometryId,
+                            { { 0.f, 0.f }, { scale, scale } });
+      }
 
-      renderer.drawFrame();
+      renderer->drawFrame();
     }
+
+    delete renderer;
+    delete window;
   }
 
   return 0;
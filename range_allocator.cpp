@@ -0,0 +1,79 @@
+#include "range_allocator.h"
+
+#include "vk_utils.h"
+
+RangeAllocator::RangeAllocator(uint64_t size)
+  : size(size)
+  , freeCount(size)
+{
+  if (size > 0)
+    freeRanges[0] = size;
+}
+
+bool
+RangeAllocator::Allocate(uint64_t count, uint64_t alignment, uint64_t* offset)
+{
+  if (count == 0) {
+    *offset = 0;
+    return true;
+  }
+
+  for (auto iter = freeRanges.begin(); iter != freeRanges.end(); ++iter) {
+    uint64_t begin = iter->first;
+    uint64_t end = iter->first + iter->second;
+    uint64_t aligned = (begin + alignment - 1) / alignment * alignment;
+
+    if (aligned + count > end)
+      continue;
+
+    // split off the padding in front and the rest behind the allocation
+    freeRanges.erase(iter);
+    if (aligned > begin)
+      freeRanges[begin] = aligned - begin;
+    if (aligned + count < end)
+      freeRanges[aligned + count] = end - aligned - count;
+
+    freeCount -= count;
+    *offset = aligned;
+    return true;
+  }
+
+  return false;
+}
+
+void
+RangeAllocator::Free(uint64_t offset, uint64_t count)
+{
+  if (count == 0)
+    return;
+
+  ASSERT_TRUE(offset + count <= size);
+  freeCount += count;
+
+  auto next = freeRanges.lower_bound(offset);
+  if (next != freeRanges.end() && offset + count == next->first) {
+    count += next->second;
+    next = freeRanges.erase(next);
+  }
+
+  if (next != freeRanges.begin()) {
+    auto prev = std::prev(next);
+    if (prev->first + prev->second == offset) {
+      prev->second += count;
+      return;
+    }
+  }
+
+  freeRanges[offset] = count;
+}
+
+uint64_t
+RangeAllocator::GetLargestFreeRange() const
+{
+  uint64_t largest = 0;
+  for (const auto& range : freeRanges) {
+    if (range.second > largest)
+      largest = range.second;
+  }
+  return largest;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+
+// first fit free list over [0, size), neighbouring free ranges are merged
+// on Free. units are up to the caller, e.g. bytes or elements.
+struct RangeAllocator
+{
+  RangeAllocator(uint64_t size);
+
+  bool Allocate(uint64_t count, uint64_t alignment, uint64_t* offset);
+  void Free(uint64_t offset, uint64_t count);
+
+  uint64_t GetSize() const { return size; }
+  uint64_t GetFreeCount() const { return freeCount; }
+  uint64_t GetLargestFreeRange() const;
+
+private:
+  uint64_t size;
+  uint64_t freeCount;
+  std::map<uint64_t, uint64_t> freeRanges; // offset -> count
+};
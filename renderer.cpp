@@ -1,12 +1,36 @@
 #include "renderer.h"
 
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+#include <glm/gtx/transform.hpp>
+
 #include "vk_init.h"
 #include "vk_utils.h"
 
-Renderer::Renderer(VulkanWindow* window)
-  : VulkanBase(window)
+static const VkFormat DEPTH_STENCIL_FORMAT = VK_FORMAT_D24_UNORM_S8_UINT;
+
+Renderer::Renderer(VulkanWindow* window,
+                   uint32_t framesInFlight,
+                   bool timelineSemaphore)
+  : VulkanBase(window, framesInFlight, timelineSemaphore)
+{
+  createBuffers();
+  createResources();
+  beginFrame();
+}
+
+Renderer::Renderer(VkExtent2D extent,
+                   uint32_t framesInFlight,
+                   bool timelineSemaphore)
+  : VulkanBase(extent, framesInFlight, timelineSemaphore)
 {
+  createBuffers();
   createResources();
+  beginFrame();
 }
 
 std::string
@@ -14,8 +38,7 @@ LoadFile(const char* _filename)
 {
   std::string buff;
 
-  FILE* file = 0;
-  fopen_s(&file, _filename, "rb");
+  FILE* file = fopen(_filename, "rb");
   if (file) {
     fseek(file, 0, SEEK_END);
     size_t bytes = ftell(file);
@@ -44,69 +67,102 @@ LoadShaderModule(VkDevice device, const char* filename)
 void
 Renderer::createResources()
 {
-  // depth stencil image / view
-  auto depthStencilFormat = VK_FORMAT_D24_UNORM_S8_UINT;
-
-  VkImageCreateInfo depthStencilImageInfo = vkiImageCreateInfo(
-    VK_IMAGE_TYPE_2D,
-    depthStencilFormat,
-    { swapchain->imageExtent.width, swapchain->imageExtent.height, 1 },
-    1,
-    1,
-    VK_SAMPLE_COUNT_1_BIT,
-    VK_IMAGE_TILING_OPTIMAL,
-    VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-    VK_SHARING_MODE_EXCLUSIVE,
-    VK_QUEUE_FAMILY_IGNORED,
-    nullptr,
-    VK_IMAGE_LAYOUT_UNDEFINED);
+  renderPassFormat = swapchain->surfaceFormat.format;
 
-  ASSERT_VK_SUCCESS(
-    vkCreateImage(device, &depthStencilImageInfo, nullptr, &depthStencilImage));
-
-  depthStencilImageMemory = vkuAllocateImageMemory(
-    device, physicalDeviceProps.memProps, depthStencilImage, true);
-  VkImageSubresourceRange dRange = { VK_IMAGE_ASPECT_STENCIL_BIT, 0, 1, 0, 1 };
-  VkImageViewCreateInfo dImageViewInfo =
-    vkiImageViewCreateInfo(depthStencilImage,
-                           VK_IMAGE_VIEW_TYPE_2D,
-                           depthStencilImageInfo.format,
-                           { VK_COMPONENT_SWIZZLE_IDENTITY,
-                             VK_COMPONENT_SWIZZLE_IDENTITY,
-                             VK_COMPONENT_SWIZZLE_IDENTITY,
-                             VK_COMPONENT_SWIZZLE_IDENTITY },
-                           dRange);
-
-  ASSERT_VK_SUCCESS(vkCreateImageView(
-    device, &dImageViewInfo, nullptr, &depthStencilImageView));
-
-  // renderpass 1:
-  // attachments: 0 depth/stencil
+  // one renderpass, the stencil is written in subpass 0 and tested by the
+  // covers in subpass 1. it never leaves the tile, so it is neither loaded
+  // nor stored and the attachment can be lazily allocated
+  // attachments: 0 color image, 1 depth stencil image, then the swapchain
+  // image when multisampled and the coverage image with analytic coverage.
+  // the color image is the swapchain image itself without multisampling
+  bool multisampled = sampleCount != VK_SAMPLE_COUNT_1_BIT;
 
   std::vector<VkAttachmentDescription> attachmentDescriptions;
+  attachmentDescriptions.push_back(vkiAttachmentDescription(
+    swapchain->surfaceFormat.format,
+    sampleCount,
+    VK_ATTACHMENT_LOAD_OP_CLEAR,
+    multisampled ? VK_ATTACHMENT_STORE_OP_DONT_CARE
+                 : VK_ATTACHMENT_STORE_OP_STORE,
+    VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+    VK_ATTACHMENT_STORE_OP_DONT_CARE,
+    VK_IMAGE_LAYOUT_UNDEFINED,
+    multisampled ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+                 : GetPresentLayout()));
+
   attachmentDescriptions.push_back(
-    vkiAttachmentDescription(depthStencilFormat,
-                             VK_SAMPLE_COUNT_1_BIT,
-                             VK_ATTACHMENT_LOAD_OP_CLEAR,
-                             VK_ATTACHMENT_STORE_OP_STORE,
+    vkiAttachmentDescription(DEPTH_STENCIL_FORMAT,
+                             sampleCount,
+                             VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                             VK_ATTACHMENT_STORE_OP_DONT_CARE,
                              VK_ATTACHMENT_LOAD_OP_CLEAR,
-                             VK_ATTACHMENT_STORE_OP_STORE,
+                             VK_ATTACHMENT_STORE_OP_DONT_CARE,
                              VK_IMAGE_LAYOUT_UNDEFINED,
                              VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL));
 
+  if (multisampled) {
+    attachmentDescriptions.push_back(
+      vkiAttachmentDescription(swapchain->surfaceFormat.format,
+                               VK_SAMPLE_COUNT_1_BIT,
+                               VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                               VK_ATTACHMENT_STORE_OP_STORE,
+                               VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                               VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                               VK_IMAGE_LAYOUT_UNDEFINED,
+                               GetPresentLayout()));
+  }
+
+  uint32_t coverageAttachmentIdx =
+    static_cast<uint32_t>(attachmentDescriptions.size());
+  if (analyticCoverage) {
+    attachmentDescriptions.push_back(
+      vkiAttachmentDescription(VK_FORMAT_R8_UNORM,
+                               sampleCount,
+                               VK_ATTACHMENT_LOAD_OP_CLEAR,
+                               VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                               VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                               VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                               VK_IMAGE_LAYOUT_UNDEFINED,
+                               VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+  }
+
+  VkAttachmentReference colorAttachmentRef =
+    vkiAttachmentReference(0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+
+  VkAttachmentReference resolveAttachmentRef =
+    vkiAttachmentReference(2, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+
   VkAttachmentReference depthStencilAttachmentRef =
-    vkiAttachmentReference(0, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+    vkiAttachmentReference(1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+
+  VkAttachmentReference coverageOutputRef = vkiAttachmentReference(
+    coverageAttachmentIdx, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+
+  VkAttachmentReference coverageInputRef = vkiAttachmentReference(
+    coverageAttachmentIdx, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 
-  VkSubpassDescription subpassDesc =
+  VkSubpassDescription subpassDescs[] = {
+    // subpass 0: stencil
     vkiSubpassDescription(VK_PIPELINE_BIND_POINT_GRAPHICS,
                           0,
                           nullptr,
-                          0,
-                          nullptr,
+                          analyticCoverage ? 1 : 0,
+                          &coverageOutputRef,
                           nullptr,
                           &depthStencilAttachmentRef,
                           0,
-                          nullptr);
+                          nullptr),
+    // subpass 1: cover
+    vkiSubpassDescription(VK_PIPELINE_BIND_POINT_GRAPHICS,
+                          analyticCoverage ? 1 : 0,
+                          &coverageInputRef,
+                          1,
+                          &colorAttachmentRef,
+                          multisampled ? &resolveAttachmentRef : nullptr,
+                          &depthStencilAttachmentRef,
+                          0,
+                          nullptr)
+  };
 
   std::vector<VkSubpassDependency> dependencies;
 
@@ -121,124 +177,67 @@ Renderer::createResources()
                            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
                          {}));
 
-  VkRenderPassCreateInfo renderPassCreateInfo = vkiRenderPassCreateInfo(
-    static_cast<uint32_t>(attachmentDescriptions.size()),
-    attachmentDescriptions.data(),
-    1,
-    &subpassDesc,
-    static_cast<uint32_t>(dependencies.size()),
-    dependencies.data());
-
-  ASSERT_VK_SUCCESS(
-    vkCreateRenderPass(device, &renderPassCreateInfo, nullptr, &renderPassPre));
-
-  // framebuffer for this pass
-  {
-    VkImageView attachments[1] = { depthStencilImageView };
-    VkFramebufferCreateInfo createInfo =
-      vkiFramebufferCreateInfo(renderPassPre,
-                               1,
-                               attachments,
-                               swapchain->imageExtent.width,
-                               swapchain->imageExtent.height,
-                               1);
-    ASSERT_VK_SUCCESS(
-      vkCreateFramebuffer(device, &createInfo, nullptr, &framebufferPre));
-  }
-
-  attachmentDescriptions.clear();
-  dependencies.clear();
-
-  // renderpass 2: post process
-  // attachments: 0 swapchain image, 1 depth stencil image
-
-  attachmentDescriptions.push_back(
-    vkiAttachmentDescription(swapchain->surfaceFormat.format,
-                             VK_SAMPLE_COUNT_1_BIT,
-                             VK_ATTACHMENT_LOAD_OP_CLEAR,
-                             VK_ATTACHMENT_STORE_OP_STORE,
-                             VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-                             VK_ATTACHMENT_STORE_OP_DONT_CARE,
-                             VK_IMAGE_LAYOUT_UNDEFINED,
-                             VK_IMAGE_LAYOUT_PRESENT_SRC_KHR));
-
-  attachmentDescriptions.push_back(
-    vkiAttachmentDescription(depthStencilFormat,
-                             VK_SAMPLE_COUNT_1_BIT,
-                             VK_ATTACHMENT_LOAD_OP_LOAD,
-                             VK_ATTACHMENT_STORE_OP_DONT_CARE,
-                             VK_ATTACHMENT_LOAD_OP_LOAD,
-                             VK_ATTACHMENT_STORE_OP_DONT_CARE,
-                             VK_IMAGE_LAYOUT_UNDEFINED,
-                             VK_IMAGE_LAYOUT_PRESENT_SRC_KHR));
-
-  VkAttachmentReference colorAttachmentRef =
-    vkiAttachmentReference(0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-
-  depthStencilAttachmentRef =
-    vkiAttachmentReference(1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
-
-  subpassDesc = vkiSubpassDescription(VK_PIPELINE_BIND_POINT_GRAPHICS,
-                                      0,
-                                      nullptr,
-                                      1,
-                                      &colorAttachmentRef,
-                                      nullptr,
-                                      &depthStencilAttachmentRef,
-                                      0,
-                                      nullptr);
-
   dependencies.push_back(vkiSubpassDependency(
     VK_SUBPASS_EXTERNAL,
-    0,
+    1,
     VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
     VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
     VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
     VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
     {}));
 
+  // covers only test the stencil of their own pixel
   dependencies.push_back(
-    vkiSubpassDependency(VK_SUBPASS_EXTERNAL,
-                         0,
+    vkiSubpassDependency(0,
+                         1,
                          VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
                          VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
-                         VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
-                           VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
-                         VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
-                           VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
-                         {}));
+                         VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                         VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                           VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                         VK_DEPENDENCY_BY_REGION_BIT));
+
+  if (analyticCoverage) {
+    dependencies.push_back(
+      vkiSubpassDependency(0,
+                           1,
+                           VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                           VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                           VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                           VK_ACCESS_INPUT_ATTACHMENT_READ_BIT,
+                           VK_DEPENDENCY_BY_REGION_BIT));
+  }
 
-  renderPassCreateInfo = vkiRenderPassCreateInfo(
+  // headless frames are read back with a transfer afterwards
+  if (IsHeadless()) {
+    dependencies.push_back(
+      vkiSubpassDependency(1,
+                           VK_SUBPASS_EXTERNAL,
+                           VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                           VK_PIPELINE_STAGE_TRANSFER_BIT,
+                           VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                           VK_ACCESS_TRANSFER_READ_BIT,
+                           {}));
+  }
+
+  VkRenderPassCreateInfo renderPassCreateInfo = vkiRenderPassCreateInfo(
     static_cast<uint32_t>(attachmentDescriptions.size()),
     attachmentDescriptions.data(),
-    1,
-    &subpassDesc,
+    2,
+    subpassDescs,
     static_cast<uint32_t>(dependencies.size()),
     dependencies.data());
 
-  ASSERT_VK_SUCCESS(vkCreateRenderPass(
-    device, &renderPassCreateInfo, nullptr, &renderPassPost));
-
-  // framebuffers for this pass
-  framebuffersPost.resize(swapchain->imageCount);
-  for (uint32_t i = 0; i < swapchain->imageCount; ++i) {
-    VkImageView attachments[] = { swapchain->imageViews[i],
-                                  depthStencilImageView };
-    VkFramebufferCreateInfo createInfo =
-      vkiFramebufferCreateInfo(renderPassPost,
-                               2,
-                               attachments,
-                               swapchain->imageExtent.width,
-                               swapchain->imageExtent.height,
-                               1);
+  ASSERT_VK_SUCCESS(
+    vkCreateRenderPass(device, &renderPassCreateInfo, nullptr, &renderPass));
 
-    ASSERT_VK_SUCCESS(
-      vkCreateFramebuffer(device, &createInfo, nullptr, &framebuffersPost[i]));
-  }
+  // shader modules and pipelines, timed to see what the pipeline cache
+  // saves at startup and on mode changes
+  auto pipelineStart = std::chrono::steady_clock::now();
 
-  // shader modules
   preFragmentShader = LoadShaderModule(device, "preSegment.frag.spv");
   preVertexShader = LoadShaderModule(device, "preSegment.vert.spv");
+  preGlyphVertexShader = LoadShaderModule(device, "preGlyphSegment.vert.spv");
 
   preFanFragmentShader = LoadShaderModule(device, "preFan.frag.spv");
   preFanVertexShader = LoadShaderModule(device, "preFan.vert.spv");
@@ -246,6 +245,13 @@ Renderer::createResources()
   postFragmentShader = LoadShaderModule(device, "post.frag.spv");
   postVertexShader = LoadShaderModule(device, "post.vert.spv");
 
+  if (analyticCoverage) {
+    preCoverageFragmentShader =
+      LoadShaderModule(device, "preSegmentCoverage.frag.spv");
+    postCoverageFragmentShader =
+      LoadShaderModule(device, "postCoverage.frag.spv");
+  }
+
   // pipelines
   VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
   colorBlendAttachment.colorWriteMask =
@@ -253,51 +259,143 @@ Renderer::createResources()
     VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
   colorBlendAttachment.blendEnable = VK_FALSE;
 
-  prePipeline =
+  // the stencil subpass only has the coverage attachment, which the
+  // stencil pipelines do not write
+  std::vector<VkPipelineColorBlendAttachmentState> stencilBlendAttachments;
+  if (analyticCoverage)
+    stencilBlendAttachments.push_back({});
+
+  // even-odd flips bit 0 with every triangle covering a pixel, nonzero
+  // counts front facing triangles up and back facing ones down in the low
+  // 7 bits. bit 7 is left to the analytic coverage covers
+  uint32_t windingMask = fillRule == FILL_RULE_NONZERO ? 0x7f : 0x01;
+  VkStencilOpState stencilFront = vkiStencilOpState(VK_STENCIL_OP_INVERT,
+                                                    VK_STENCIL_OP_INVERT,
+                                                    {},
+                                                    VK_COMPARE_OP_NOT_EQUAL,
+                                                    1,
+                                                    1,
+                                                    0);
+  VkStencilOpState stencilBack = stencilFront;
+  if (fillRule == FILL_RULE_NONZERO) {
+    stencilFront = vkiStencilOpState(VK_STENCIL_OP_KEEP,
+                                     VK_STENCIL_OP_INCREMENT_AND_WRAP,
+                                     {},
+                                     VK_COMPARE_OP_ALWAYS,
+                                     0,
+                                     windingMask,
+                                     0);
+    stencilBack = stencilFront;
+    stencilBack.passOp = VK_STENCIL_OP_DECREMENT_AND_WRAP;
+  }
+
+  // per-vertex attributes followed by the per-instance placement
+  auto preVertexAttributes = Vertex::GetAttributeDescriptions();
+  auto instanceAttributes = InstanceData::GetAttributeDescriptions(
+    static_cast<uint32_t>(preVertexAttributes.size()), false);
+  preVertexAttributes.insert(preVertexAttributes.end(),
+                             instanceAttributes.begin(),
+                             instanceAttributes.end());
+
+  auto preGlyphVertexAttributes = GlyphVertex::GetAttributeDescriptions();
+  instanceAttributes = InstanceData::GetAttributeDescriptions(
+    static_cast<uint32_t>(preGlyphVertexAttributes.size()), true);
+  preGlyphVertexAttributes.insert(preGlyphVertexAttributes.end(),
+                                  instanceAttributes.begin(),
+                                  instanceAttributes.end());
+
+  auto preFanVertexAttributes = SimpleVertex::GetAttributeDescriptions();
+  instanceAttributes = InstanceData::GetAttributeDescriptions(
+    static_cast<uint32_t>(preFanVertexAttributes.size()), false);
+  preFanVertexAttributes.insert(preFanVertexAttributes.end(),
+                                instanceAttributes.begin(),
+                                instanceAttributes.end());
+
+  auto prePipelineBuilder =
     GraphicsPipeline::GetBuilder()
       .SetDevice(device)
+      .SetPipelineCache(pipelineCache)
       .SetVertexShader(preVertexShader)
       .SetFragmentShader(preFragmentShader)
-      .SetVertexBindings({ Vertex::GetBindingDescription() })
-      .SetVertexAttributes(Vertex::GetAttributeDescriptions())
+      .SetVertexBindings({ Vertex::GetBindingDescription(),
+                           InstanceData::GetBindingDescription() })
+      .SetVertexAttributes(preVertexAttributes)
+      .SetPushConstantRanges(
+        { { VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4) } })
       .SetPrimitiveTopology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST)
-      .SetViewports({ { 0.0f,
-                        0.0f,
-                        (float)swapchain->imageExtent.width,
-                        (float)swapchain->imageExtent.height,
-                        0.0f,
-                        1.0f } })
-      .SetScissors(
-        { { { 0, 0 },
-            { swapchain->imageExtent.width, swapchain->imageExtent.height } } })
-      .SetColorBlendAttachments({ colorBlendAttachment })
+      .SetDynamicStates(
+        { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR })
       .SetDepthWriteEnable(VK_FALSE)
       .SetDepthTestEnable(VK_FALSE)
       .SetStencilTestEnable(VK_TRUE)
-      .SetFront(vkiStencilOpState(VK_STENCIL_OP_INVERT,
-                                  VK_STENCIL_OP_INVERT,
-                                  {},
-                                  VK_COMPARE_OP_NOT_EQUAL,
-                                  1,
-                                  1,
-                                  0))
-      .SetBack(vkiStencilOpState(VK_STENCIL_OP_INVERT,
-                                 VK_STENCIL_OP_INVERT,
-                                 {},
-                                 VK_COMPARE_OP_NOT_EQUAL,
-                                 1,
-                                 1,
-                                 0))
-      .SetRenderPass(renderPassPre)
+      .SetFront(stencilFront)
+      .SetBack(stencilBack)
+      .SetColorBlendAttachments(stencilBlendAttachments)
+      .SetRasterizationSamples(sampleCount)
+      .SetSampleShadingEnable(sampleShading)
+      .SetMinSampleShading(1.f)
+      .SetRenderPass(renderPass)
+      .SetSubpass(0);
+
+  prePipeline = prePipelineBuilder.Build();
+  preGlyphPipeline =
+    prePipelineBuilder.SetVertexShader(preGlyphVertexShader)
+      .SetVertexBindings({ GlyphVertex::GetBindingDescription(),
+                           InstanceData::GetBindingDescription() })
+      .SetVertexAttributes(preGlyphVertexAttributes)
       .Build();
 
-  preFanPipeline =
+  if (analyticCoverage) {
+    // coverage of overlapping segment edges is combined with max
+    VkPipelineColorBlendAttachmentState coverageBlendAttachment = {};
+    coverageBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT;
+    coverageBlendAttachment.blendEnable = VK_TRUE;
+    coverageBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+    coverageBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+    coverageBlendAttachment.colorBlendOp = VK_BLEND_OP_MAX;
+
+    auto preCoveragePipelineBuilder =
+      GraphicsPipeline::GetBuilder()
+        .SetDevice(device)
+        .SetPipelineCache(pipelineCache)
+        .SetVertexShader(preVertexShader)
+        .SetFragmentShader(preCoverageFragmentShader)
+        .SetVertexBindings({ Vertex::GetBindingDescription(),
+                             InstanceData::GetBindingDescription() })
+        .SetVertexAttributes(preVertexAttributes)
+        .SetPushConstantRanges(
+          { { VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4) } })
+        .SetPrimitiveTopology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST)
+        .SetDynamicStates(
+          { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR })
+        .SetColorBlendAttachments({ coverageBlendAttachment })
+        .SetDepthWriteEnable(VK_FALSE)
+        .SetDepthTestEnable(VK_FALSE)
+        .SetStencilTestEnable(VK_FALSE)
+        .SetRasterizationSamples(sampleCount)
+        .SetRenderPass(renderPass)
+        .SetSubpass(0);
+
+    preCoveragePipeline = preCoveragePipelineBuilder.Build();
+    preGlyphCoveragePipeline =
+      preCoveragePipelineBuilder.SetVertexShader(preGlyphVertexShader)
+        .SetVertexBindings({ GlyphVertex::GetBindingDescription(),
+                             InstanceData::GetBindingDescription() })
+        .SetVertexAttributes(preGlyphVertexAttributes)
+        .Build();
+  }
+
+  auto preFanPipelineBuilder =
     GraphicsPipeline::GetBuilder()
       .SetDevice(device)
+      .SetPipelineCache(pipelineCache)
       .SetVertexShader(preFanVertexShader)
       .SetFragmentShader(preFanFragmentShader)
-      .SetVertexBindings({ SimpleVertex::GetBindingDescription() })
-      .SetVertexAttributes(SimpleVertex::GetAttributeDescriptions())
+      .SetVertexBindings({ SimpleVertex::GetBindingDescription(),
+                           InstanceData::GetBindingDescription() })
+      .SetVertexAttributes(preFanVertexAttributes)
+      .SetPushConstantRanges(
+        { { VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4) } })
       .SetPrimitiveTopology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_FAN)
       .SetDescriptorSetLayouts(
         { { { 0,
@@ -308,72 +406,117 @@ Renderer::createResources()
               VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
               1,
               VK_SHADER_STAGE_FRAGMENT_BIT } } })
-      .SetViewports({ { 0.0f,
-                        0.0f,
-                        (float)swapchain->imageExtent.width,
-                        (float)swapchain->imageExtent.height,
-                        0.0f,
-                        1.0f } })
-      .SetScissors(
-        { { { 0, 0 },
-            { swapchain->imageExtent.width, swapchain->imageExtent.height } } })
-      .SetColorBlendAttachments({ colorBlendAttachment })
+      .SetDynamicStates(
+        { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR })
       .SetDepthWriteEnable(VK_FALSE)
       .SetDepthTestEnable(VK_FALSE)
       .SetStencilTestEnable(VK_TRUE)
-      .SetFront(vkiStencilOpState(VK_STENCIL_OP_INVERT,
-                                  VK_STENCIL_OP_INVERT,
-                                  {},
-                                  VK_COMPARE_OP_NOT_EQUAL,
-                                  1,
-                                  1,
-                                  0))
-      .SetBack(vkiStencilOpState(VK_STENCIL_OP_INVERT,
-                                 VK_STENCIL_OP_INVERT,
-                                 {},
-                                 VK_COMPARE_OP_NOT_EQUAL,
-                                 1,
-                                 1,
-                                 0))
-      .SetRenderPass(renderPassPre)
+      .SetFront(stencilFront)
+      .SetBack(stencilBack)
+      .SetColorBlendAttachments(stencilBlendAttachments)
+      .SetRasterizationSamples(sampleCount)
+      .SetRenderPass(renderPass)
+      .SetSubpass(0);
+
+  preFanPipeline = preFanPipelineBuilder.Build();
+  preFanListPipeline =
+    preFanPipelineBuilder
+      .SetPrimitiveTopology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST)
       .Build();
 
-  postPipeline =
+  // covers push the view transform and whether they cover the inside or
+  // the outside of the stenciled area
+  auto coverPipelineBuilder =
     GraphicsPipeline::GetBuilder()
       .SetDevice(device)
+      .SetPipelineCache(pipelineCache)
       .SetVertexShader(postVertexShader)
       .SetFragmentShader(postFragmentShader)
-      .SetVertexBindings({ SimpleVertex::GetBindingDescription() })
-      .SetVertexAttributes(SimpleVertex::GetAttributeDescriptions())
-      .SetViewports({ { 0.0f,
-                        0.0f,
-                        (float)swapchain->imageExtent.width,
-                        (float)swapchain->imageExtent.height,
-                        0.0f,
-                        1.0f } })
-      .SetScissors(
-        { { { 0, 0 },
-            { swapchain->imageExtent.width, swapchain->imageExtent.height } } })
+      .SetVertexBindings({ SimpleVertex::GetBindingDescription(),
+                           InstanceData::GetBindingDescription() })
+      .SetVertexAttributes(preFanVertexAttributes)
+      .SetPushConstantRanges(
+        { { VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4) },
+          { VK_SHADER_STAGE_FRAGMENT_BIT,
+            sizeof(glm::mat4),
+            sizeof(uint32_t) } })
+      .SetDynamicStates(
+        { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR })
       .SetColorBlendAttachments({ colorBlendAttachment })
       .SetDepthWriteEnable(VK_FALSE)
       .SetDepthTestEnable(VK_FALSE)
       .SetStencilTestEnable(VK_TRUE)
+      // covers of overlapping boxes shade every pixel once
       .SetFront(vkiStencilOpState(VK_STENCIL_OP_KEEP,
-                                  VK_STENCIL_OP_KEEP,
+                                  VK_STENCIL_OP_ZERO,
                                   {},
                                   VK_COMPARE_OP_NOT_EQUAL,
-                                  1,
-                                  1,
+                                  windingMask,
+                                  windingMask,
                                   0))
       .SetBack(vkiStencilOpState(VK_STENCIL_OP_KEEP,
-                                 VK_STENCIL_OP_KEEP,
+                                 VK_STENCIL_OP_ZERO,
                                  {},
                                  VK_COMPARE_OP_NOT_EQUAL,
-                                 1,
-                                 1,
+                                 windingMask,
+                                 windingMask,
                                  0))
-      .SetRenderPass(renderPassPost)
-      .Build();
+      .SetRasterizationSamples(sampleCount)
+      .SetRenderPass(renderPass)
+      .SetSubpass(1);
+
+  postPipeline = coverPipelineBuilder.Build();
+
+  if (analyticCoverage) {
+    // edge pixels are blended with their coverage. the outside covers
+    // shade pixels with a clear stencil and mark them with bit 7, after
+    // that every unmarked pixel of a box is inside and the inside covers
+    // replace it with the mark, so every pixel is shaded once however many
+    // boxes overlap it
+    VkPipelineColorBlendAttachmentState coverBlendAttachment =
+      colorBlendAttachment;
+    coverBlendAttachment.blendEnable = VK_TRUE;
+    coverBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    coverBlendAttachment.dstColorBlendFactor =
+      VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    coverBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+    coverBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    coverBlendAttachment.dstAlphaBlendFactor =
+      VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    coverBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+    VkStencilOpState outside = vkiStencilOpState(VK_STENCIL_OP_KEEP,
+                                                 VK_STENCIL_OP_INVERT,
+                                                 {},
+                                                 VK_COMPARE_OP_EQUAL,
+                                                 0xff,
+                                                 0x80,
+                                                 0);
+    // passes for 0x80 > stencil, any winding without the mark
+    VkStencilOpState inside = vkiStencilOpState(VK_STENCIL_OP_KEEP,
+                                                VK_STENCIL_OP_REPLACE,
+                                                {},
+                                                VK_COMPARE_OP_GREATER,
+                                                0xff,
+                                                0xff,
+                                                0x80);
+
+    coverPipelineBuilder.SetFragmentShader(postCoverageFragmentShader)
+      .SetDescriptorSetLayouts({ { { 0,
+                                     VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,
+                                     1,
+                                     VK_SHADER_STAGE_FRAGMENT_BIT } } })
+      .SetColorBlendAttachments({ coverBlendAttachment });
+
+    coverOutsidePipeline =
+      coverPipelineBuilder.SetFront(outside).SetBack(outside).Build();
+    coverInsidePipeline =
+      coverPipelineBuilder.SetFront(inside).SetBack(inside).Build();
+  }
+
+  std::chrono::duration<double, std::milli> pipelineTime =
+    std::chrono::steady_clock::now() - pipelineStart;
+  pipelineCreateTime = pipelineTime.count();
 
   // vertex buffer
   std::vector<float> floats = { -1.0f, -1.0f, 0.0f, 1.0f, -1.0f, 0.0f,
@@ -384,241 +527,1378 @@ Renderer::createResources()
 
   vertexBuffer = vkuCreateBuffer(device,
                                  size,
-                                 VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                                 VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+                                   VK_BUFFER_USAGE_TRANSFER_DST_BIT,
                                  VK_SHARING_MODE_EXCLUSIVE,
                                  {});
   vertexBufferMemory =
     vkuAllocateBufferMemory(device,
-                            physicalDeviceProps.memProps,
+                            memoryAllocator,
                             vertexBuffer,
                             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
                             true);
 
-  vkuTransferData(device, vertexBufferMemory, 0, size, floats.data());
+  uploadManager->UploadBuffer(vertexBuffer, 0, size, floats.data());
 
-  dynamicVertexBuffer = vkuCreateBuffer(device,
-                                        DYN_VERTEX_BUFFER_SIZE,
-                                        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-                                        VK_SHARING_MODE_EXCLUSIVE,
-                                        {});
+  createRenderTargets();
+}
 
-  dynamicVertexBufferMemory =
-    vkuAllocateBufferMemory(device,
-                            physicalDeviceProps.memProps,
-                            dynamicVertexBuffer,
-                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-                            true);
+void
+Renderer::createRenderTargets()
+{
+  bool multisampled = sampleCount != VK_SAMPLE_COUNT_1_BIT;
 
-  hostDynamicVertexBuffer = (uint8_t*)malloc(DYN_VERTEX_BUFFER_SIZE);
+  // depth stencil image / view
+  VkImageCreateInfo depthStencilImageInfo = vkiImageCreateInfo(
+    VK_IMAGE_TYPE_2D,
+    DEPTH_STENCIL_FORMAT,
+    { swapchain->imageExtent.width, swapchain->imageExtent.height, 1 },
+    1,
+    1,
+    sampleCount,
+    VK_IMAGE_TILING_OPTIMAL,
+    VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+      VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+    VK_SHARING_MODE_EXCLUSIVE,
+    VK_QUEUE_FAMILY_IGNORED,
+    nullptr,
+    VK_IMAGE_LAYOUT_UNDEFINED);
+
+  ASSERT_VK_SUCCESS(vkCreateImage(
+    device, &depthStencilImageInfo, nullptr, &targets.depthStencilImage));
 
-  vkMapMemory(device,
-              dynamicVertexBufferMemory,
-              0,
-              DYN_VERTEX_BUFFER_SIZE,
-              0,
-              (void**)&hostDynamicVertexBuffer);
+  targets.depthStencilImageMemory =
+    vkuAllocateImageMemory(device,
+                           memoryAllocator,
+                           targets.depthStencilImage,
+                           VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+                             VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT,
+                           true);
+  VkImageSubresourceRange dRange = { VK_IMAGE_ASPECT_STENCIL_BIT, 0, 1, 0, 1 };
+  VkImageViewCreateInfo dImageViewInfo =
+    vkiImageViewCreateInfo(targets.depthStencilImage,
+                           VK_IMAGE_VIEW_TYPE_2D,
+                           depthStencilImageInfo.format,
+                           { VK_COMPONENT_SWIZZLE_IDENTITY,
+                             VK_COMPONENT_SWIZZLE_IDENTITY,
+                             VK_COMPONENT_SWIZZLE_IDENTITY,
+                             VK_COMPONENT_SWIZZLE_IDENTITY },
+                           dRange);
+
+  ASSERT_VK_SUCCESS(vkCreateImageView(
+    device, &dImageViewInfo, nullptr, &targets.depthStencilImageView));
+
+  // multisampled color image, resolved into the swapchain image at the end
+  // of the cover subpass and never stored itself
+  if (sampleCount != VK_SAMPLE_COUNT_1_BIT) {
+    VkImageCreateInfo colorImageInfo = vkiImageCreateInfo(
+      VK_IMAGE_TYPE_2D,
+      swapchain->surfaceFormat.format,
+      { swapchain->imageExtent.width, swapchain->imageExtent.height, 1 },
+      1,
+      1,
+      sampleCount,
+      VK_IMAGE_TILING_OPTIMAL,
+      VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+        VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+      VK_SHARING_MODE_EXCLUSIVE,
+      VK_QUEUE_FAMILY_IGNORED,
+      nullptr,
+      VK_IMAGE_LAYOUT_UNDEFINED);
+
+    ASSERT_VK_SUCCESS(
+      vkCreateImage(device, &colorImageInfo, nullptr, &targets.colorImage));
+
+    targets.colorImageMemory =
+      vkuAllocateImageMemory(device,
+                             memoryAllocator,
+                             targets.colorImage,
+                             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+                               VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT,
+                             true);
+
+    VkImageViewCreateInfo colorImageViewInfo =
+      vkiImageViewCreateInfo(targets.colorImage,
+                             VK_IMAGE_VIEW_TYPE_2D,
+                             colorImageInfo.format,
+                             { VK_COMPONENT_SWIZZLE_IDENTITY,
+                               VK_COMPONENT_SWIZZLE_IDENTITY,
+                               VK_COMPONENT_SWIZZLE_IDENTITY,
+                               VK_COMPONENT_SWIZZLE_IDENTITY },
+                             { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 });
+
+    ASSERT_VK_SUCCESS(vkCreateImageView(
+      device, &colorImageViewInfo, nullptr, &targets.colorImageView));
+  }
+
+  // per pixel edge coverage of the curve segments, written in the stencil
+  // subpass and read as input attachment by the covers
+  if (analyticCoverage) {
+    VkImageCreateInfo coverageImageInfo = vkiImageCreateInfo(
+      VK_IMAGE_TYPE_2D,
+      VK_FORMAT_R8_UNORM,
+      { swapchain->imageExtent.width, swapchain->imageExtent.height, 1 },
+      1,
+      1,
+      sampleCount,
+      VK_IMAGE_TILING_OPTIMAL,
+      VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+        VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT |
+        VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+      VK_SHARING_MODE_EXCLUSIVE,
+      VK_QUEUE_FAMILY_IGNORED,
+      nullptr,
+      VK_IMAGE_LAYOUT_UNDEFINED);
+
+    ASSERT_VK_SUCCESS(vkCreateImage(
+      device, &coverageImageInfo, nullptr, &targets.coverageImage));
+
+    targets.coverageImageMemory =
+      vkuAllocateImageMemory(device,
+                             memoryAllocator,
+                             targets.coverageImage,
+                             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+                               VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT,
+                             true);
+
+    VkImageViewCreateInfo coverageImageViewInfo =
+      vkiImageViewCreateInfo(targets.coverageImage,
+                             VK_IMAGE_VIEW_TYPE_2D,
+                             coverageImageInfo.format,
+                             { VK_COMPONENT_SWIZZLE_IDENTITY,
+                               VK_COMPONENT_SWIZZLE_IDENTITY,
+                               VK_COMPONENT_SWIZZLE_IDENTITY,
+                               VK_COMPONENT_SWIZZLE_IDENTITY },
+                             { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 });
+
+    ASSERT_VK_SUCCESS(vkCreateImageView(
+      device, &coverageImageViewInfo, nullptr, &targets.coverageImageView));
+  }
+
+  // framebuffers, the depth stencil image is shared by all of them
+  targets.framebuffers.resize(swapchain->imageCount);
+  for (uint32_t i = 0; i < swapchain->imageCount; ++i) {
+    std::vector<VkImageView> attachments;
+    if (multisampled) {
+      attachments = { targets.colorImageView,
+                      targets.depthStencilImageView,
+                      swapchain->imageViews[i] };
+    } else {
+      attachments = { swapchain->imageViews[i],
+                      targets.depthStencilImageView };
+    }
+    if (analyticCoverage)
+      attachments.push_back(targets.coverageImageView);
+
+    VkFramebufferCreateInfo createInfo =
+      vkiFramebufferCreateInfo(renderPass,
+                               static_cast<uint32_t>(attachments.size()),
+                               attachments.data(),
+                               swapchain->imageExtent.width,
+                               swapchain->imageExtent.height,
+                               1);
+
+    ASSERT_VK_SUCCESS(vkCreateFramebuffer(
+      device, &createInfo, nullptr, &targets.framebuffers[i]));
+  }
+
+  // the coverage input attachment, a set per targets so the one of frames
+  // in flight is not updated
+  if (analyticCoverage) {
+    VkDescriptorPoolSize poolSize = { VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1 };
+    VkDescriptorPoolCreateInfo poolInfo =
+      vkiDescriptorPoolCreateInfo(1, 1, &poolSize);
+    ASSERT_VK_SUCCESS(vkCreateDescriptorPool(
+      device, &poolInfo, nullptr, &targets.descriptorPool));
+
+    VkDescriptorSetAllocateInfo allocInfo = vkiDescriptorSetAllocateInfo(
+      targets.descriptorPool, 1, &coverInsidePipeline->descriptorSetLayouts[0]);
+    ASSERT_VK_SUCCESS(vkAllocateDescriptorSets(
+      device, &allocInfo, &targets.coverageDescriptorSet));
+
+    VkDescriptorImageInfo imageInfo =
+      vkiDescriptorImageInfo(VK_NULL_HANDLE,
+                             targets.coverageImageView,
+                             VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    VkWriteDescriptorSet write =
+      vkiWriteDescriptorSet(targets.coverageDescriptorSet,
+                            0,
+                            0,
+                            1,
+                            VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,
+                            &imageInfo,
+                            nullptr,
+                            nullptr);
+    vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+  }
+
+  // gpu frame timing, two timestamps per frame slot. the slots do not
+  // depend on the swapchain, so the pool survives a resize
+  if (timestampQueryPool == VK_NULL_HANDLE &&
+      physicalDeviceProps.props.limits.timestampComputeAndGraphics) {
+    VkQueryPoolCreateInfo queryPoolInfo = vkiQueryPoolCreateInfo(
+      VK_QUERY_TYPE_TIMESTAMP, 2 * framesInFlight, 0);
+
+    ASSERT_VK_SUCCESS(vkCreateQueryPool(
+      device, &queryPoolInfo, nullptr, &timestampQueryPool));
+    timestampsWritten.assign(framesInFlight, false);
+  }
 }
 
 Renderer::~Renderer()
 {
   vkQueueWaitIdle(queue);
+  // their deleters still need the renderer
+  ReleaseRetiredSwapchains(true);
   destroyResources();
+  destroyBuffers();
+}
+
+void
+Renderer::createBuffers()
+{
+  uploadManager = new UploadManager(
+    device, memoryAllocator, cmdPool, queue, UPLOAD_STAGING_SIZE);
+
+  struct
+  {
+    uint32_t size;
+    uint32_t elementSize;
+    VkBufferUsageFlags usage;
+  } heapInfos[GLYPH_HEAP_COUNT] = {
+    { GLYPH_SEGMENT_HEAP_SIZE,
+      sizeof(GlyphSegment),
+      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT },
+    { GLYPH_FAN_VERTEX_HEAP_SIZE,
+      sizeof(glm::vec3),
+      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT },
+    { GLYPH_FAN_INDEX_HEAP_SIZE,
+      sizeof(uint32_t),
+      VK_BUFFER_USAGE_INDEX_BUFFER_BIT },
+  };
+
+  for (uint32_t i = 0; i < GLYPH_HEAP_COUNT; ++i) {
+    GlyphHeap& heap = glyphHeaps[i];
+    uint32_t elementCount = heapInfos[i].size / heapInfos[i].elementSize;
+
+    heap.elementSize = heapInfos[i].elementSize;
+    heap.allocator = new RangeAllocator(elementCount);
+    heap.buffer = vkuCreateBuffer(
+      device,
+      elementCount * heap.elementSize,
+      heapInfos[i].usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_SHARING_MODE_EXCLUSIVE,
+      {});
+    heap.memory = vkuAllocateBufferMemory(device,
+                                          memoryAllocator,
+                                          heap.buffer,
+                                          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                          true);
+  }
+
+  dynamicVertexRing = new FrameRingBuffer(device,
+                                          memoryAllocator,
+                                          VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                                          DYN_VERTEX_FRAME_SIZE,
+                                          framesInFlight);
+
+  fanIndexRing = new FrameRingBuffer(device,
+                                     memoryAllocator,
+                                     VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                                     FAN_INDEX_FRAME_SIZE,
+                                     framesInFlight);
+
+  instanceRing = new FrameRingBuffer(device,
+                                     memoryAllocator,
+                                     VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                                     INSTANCE_FRAME_SIZE,
+                                     framesInFlight);
+
+  for (auto& ring : indirectRings) {
+    ring = new FrameRingBuffer(device,
+                               memoryAllocator,
+                               VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                               INDIRECT_FRAME_SIZE,
+                               framesInFlight);
+  }
+}
+
+void
+Renderer::destroyBuffers()
+{
+  delete uploadManager;
+  uploadManager = nullptr;
+
+  delete dynamicVertexRing;
+  dynamicVertexRing = nullptr;
+  delete fanIndexRing;
+  fanIndexRing = nullptr;
+  delete instanceRing;
+  instanceRing = nullptr;
+  for (auto& ring : indirectRings) {
+    delete ring;
+    ring = nullptr;
+  }
+
+  for (auto& heap : glyphHeaps) {
+    vkDestroyBuffer(device, heap.buffer, nullptr);
+    memoryAllocator->Free(heap.memory);
+    delete heap.allocator;
+    heap = {};
+  }
+}
+
+void
+Renderer::pushIndirectDraw(IndirectRegion region,
+                           const VkDrawIndirectCommand& command)
+{
+  if (!physicalDeviceProps.features.drawIndirectFirstInstance) {
+    directDraws[region].push_back(command);
+    ++numIndirectDraws[region];
+    return;
+  }
+
+  FrameRingBuffer* ring = indirectRings[region];
+  memcpy(ring->GetPointer(ring->Allocate(INDIRECT_STRIDE, 4)),
+         &command,
+         sizeof(command));
+  ++numIndirectDraws[region];
+}
+
+void
+Renderer::pushIndirectDraw(IndirectRegion region,
+                           const VkDrawIndexedIndirectCommand& command)
+{
+  if (!physicalDeviceProps.features.drawIndirectFirstInstance) {
+    directIndexedDraws.push_back(command);
+    ++numIndirectDraws[region];
+    return;
+  }
+
+  FrameRingBuffer* ring = indirectRings[region];
+  memcpy(ring->GetPointer(ring->Allocate(INDIRECT_STRIDE, 4)),
+         &command,
+         sizeof(command));
+  ++numIndirectDraws[region];
+}
+
+void
+Renderer::recordIndirectDraws(VkCommandBuffer commandBuffer,
+                              IndirectRegion region)
+{
+  if (!physicalDeviceProps.features.drawIndirectFirstInstance &&
+      region == INDIRECT_REGION_GLYPH_FAN_LISTS) {
+    for (const auto& command : directIndexedDraws) {
+      vkCmdDrawIndexed(commandBuffer,
+                       command.indexCount,
+                       command.instanceCount,
+                       command.firstIndex,
+                       command.vertexOffset,
+                       command.firstInstance);
+    }
+    return;
+  }
+
+  if (!physicalDeviceProps.features.drawIndirectFirstInstance) {
+    for (const auto& command : directDraws[region]) {
+      vkCmdDraw(commandBuffer,
+                command.vertexCount,
+                command.instanceCount,
+                command.firstVertex,
+                command.firstInstance);
+    }
+    return;
+  }
+
+  // without multiDrawIndirect every command needs its own call
+  uint32_t maxDrawCount = 1;
+  if (physicalDeviceProps.features.multiDrawIndirect) {
+    maxDrawCount = physicalDeviceProps.props.limits.maxDrawIndirectCount;
+  }
+
+  // commands of a region are tightly packed in the current ring slot
+  FrameRingBuffer* ring = indirectRings[region];
+
+  for (uint32_t first = 0; first < numIndirectDraws[region];
+       first += maxDrawCount) {
+    uint32_t drawCount = numIndirectDraws[region] - first;
+    if (drawCount > maxDrawCount)
+      drawCount = maxDrawCount;
+
+    VkDeviceSize offset = ring->GetFrameOffset() + first * INDIRECT_STRIDE;
+
+    if (region == INDIRECT_REGION_GLYPH_FAN_LISTS) {
+      vkCmdDrawIndexedIndirect(commandBuffer,
+                               ring->GetBuffer(),
+                               offset,
+                               drawCount,
+                               INDIRECT_STRIDE);
+    } else {
+      vkCmdDrawIndirect(commandBuffer,
+                        ring->GetBuffer(),
+                        offset,
+                        drawCount,
+                        INDIRECT_STRIDE);
+    }
+  }
+}
+
+uint32_t
+Renderer::writeFanIndices(uint32_t* indices,
+                          uint32_t baseVertex,
+                          uint32_t count)
+{
+  uint32_t numIndices = 0;
+  for (uint32_t i = 1; i + 1 < count; ++i) {
+    indices[numIndices++] = baseVertex;
+    indices[numIndices++] = baseVertex + i;
+    indices[numIndices++] = baseVertex + i + 1;
+  }
+  return numIndices;
 }
 
 void
 Renderer::destroyResources()
 {
+  // uploads into the buffers below might still be pending
+  uploadManager->Wait(uploadManager->Flush());
+
+  destroyRenderTargets(targets);
+
+  vkDestroyQueryPool(device, timestampQueryPool, nullptr);
+  timestampQueryPool = VK_NULL_HANDLE;
+
   // buffers
   vkDestroyBuffer(device, vertexBuffer, nullptr);
-  vkFreeMemory(device, vertexBufferMemory, nullptr);
-
-  vkDestroyBuffer(device, dynamicVertexBuffer, nullptr);
-  vkFreeMemory(device, dynamicVertexBufferMemory, nullptr);
+  memoryAllocator->Free(vertexBufferMemory);
 
   // shader modules
   vkDestroyShaderModule(device, preFragmentShader, nullptr);
   vkDestroyShaderModule(device, preVertexShader, nullptr);
+  vkDestroyShaderModule(device, preGlyphVertexShader, nullptr);
   vkDestroyShaderModule(device, preFanFragmentShader, nullptr);
   vkDestroyShaderModule(device, preFanVertexShader, nullptr);
   vkDestroyShaderModule(device, postFragmentShader, nullptr);
   vkDestroyShaderModule(device, postVertexShader, nullptr);
+  vkDestroyShaderModule(device, preCoverageFragmentShader, nullptr);
+  vkDestroyShaderModule(device, postCoverageFragmentShader, nullptr);
+  preCoverageFragmentShader = VK_NULL_HANDLE;
+  postCoverageFragmentShader = VK_NULL_HANDLE;
 
   // pipelines
   delete prePipeline;
   prePipeline = nullptr;
+  delete preGlyphPipeline;
+  preGlyphPipeline = nullptr;
   delete preFanPipeline;
   preFanPipeline = nullptr;
+  delete preFanListPipeline;
+  preFanListPipeline = nullptr;
   delete postPipeline;
   postPipeline = nullptr;
+  delete preCoveragePipeline;
+  preCoveragePipeline = nullptr;
+  delete preGlyphCoveragePipeline;
+  preGlyphCoveragePipeline = nullptr;
+  delete coverOutsidePipeline;
+  coverOutsidePipeline = nullptr;
+  delete coverInsidePipeline;
+  coverInsidePipeline = nullptr;
+
+  vkDestroyRenderPass(device, renderPass, nullptr);
+}
 
-  // renderpasses and framebuffers
-  for (auto fb : framebuffersPost) {
+void
+Renderer::destroyRenderTargets(RenderTargets& renderTargets)
+{
+  for (auto fb : renderTargets.framebuffers) {
     vkDestroyFramebuffer(device, fb, nullptr);
   }
-  vkDestroyRenderPass(device, renderPassPost, nullptr);
-  vkDestroyFramebuffer(device, framebufferPre, nullptr);
-  vkDestroyRenderPass(device, renderPassPre, nullptr);
-  vkDestroyImageView(device, depthStencilImageView, nullptr);
-  vkDestroyImage(device, depthStencilImage, nullptr);
-  vkFreeMemory(device, depthStencilImageMemory, nullptr);
+
+  vkDestroyImageView(device, renderTargets.depthStencilImageView, nullptr);
+  vkDestroyImage(device, renderTargets.depthStencilImage, nullptr);
+  memoryAllocator->Free(renderTargets.depthStencilImageMemory);
+
+  if (renderTargets.colorImage != VK_NULL_HANDLE) {
+    vkDestroyImageView(device, renderTargets.colorImageView, nullptr);
+    vkDestroyImage(device, renderTargets.colorImage, nullptr);
+    memoryAllocator->Free(renderTargets.colorImageMemory);
+  }
+
+  if (renderTargets.coverageImage != VK_NULL_HANDLE) {
+    vkDestroyImageView(device, renderTargets.coverageImageView, nullptr);
+    vkDestroyImage(device, renderTargets.coverageImage, nullptr);
+    memoryAllocator->Free(renderTargets.coverageImageMemory);
+  }
+
+  // the set is freed with its pool
+  vkDestroyDescriptorPool(device, renderTargets.descriptorPool, nullptr);
+
+  renderTargets = {};
 }
 
 void
 Renderer::recordCommandBuffer(uint32_t idx)
 {
-  ASSERT_VK_SUCCESS(
-    vkWaitForFences(device, 1, &fences[idx], true, (uint64_t)-1));
-  ASSERT_VK_SUCCESS(vkResetFences(device, 1, &fences[idx]));
-  ASSERT_VK_SUCCESS(vkResetCommandBuffer(commandBuffers[idx], 0));
+  // AcquireImage waited for the frame that used this slot last
+  VkCommandBuffer commandBuffer = GetFrame().commandBuffer;
+  uint32_t slot = frameSerial % framesInFlight;
+  ASSERT_VK_SUCCESS(vkResetCommandBuffer(commandBuffer, 0));
+
+  // timestamps of the last frame in this slot are available
+  if (timestampQueryPool != VK_NULL_HANDLE && timestampsWritten[slot]) {
+    uint64_t timestamps[2] = {};
+    if (vkGetQueryPoolResults(device,
+                              timestampQueryPool,
+                              2 * slot,
+                              2,
+                              sizeof(timestamps),
+                              timestamps,
+                              sizeof(uint64_t),
+                              VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+      gpuFrameTime = (timestamps[1] - timestamps[0]) *
+                     physicalDeviceProps.props.limits.timestampPeriod * 1e-6;
+    }
+  }
 
   VkCommandBufferBeginInfo beginInfo = vkiCommandBufferBeginInfo(nullptr);
-  ASSERT_VK_SUCCESS(vkBeginCommandBuffer(commandBuffers[idx], &beginInfo));
+  ASSERT_VK_SUCCESS(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+
+  if (timestampQueryPool != VK_NULL_HANDLE) {
+    vkCmdResetQueryPool(commandBuffer, timestampQueryPool, 2 * slot, 2);
+    vkCmdWriteTimestamp(commandBuffer,
+                        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                        timestampQueryPool,
+                        2 * slot);
+    timestampsWritten[slot] = true;
+  }
 
-  // prepass
+  // pushed geometry is already in clip space, glyph instances are placed
+  // in a space with y in [-1, 1] and x corrected for the aspect ratio
+  glm::mat4 identity(1.f);
+  glm::mat4 viewTransform = glm::scale(glm::vec3(
+    swapchain->imageExtent.height / (float)swapchain->imageExtent.width,
+    1.f,
+    1.f));
+
+  // buffers may have grown while the frame was built, so the current
+  // ring buffers are bound here
+  VkBuffer instanceBuffer = instanceRing->GetBuffer();
+  VkDeviceSize instanceOffset = instanceRing->GetFrameOffset();
+
+  // the resolve attachment is not cleared, its value is ignored
+  VkClearValue clearValues[4] = {};
+  VkRenderPassBeginInfo renderPassInfo =
+    vkiRenderPassBeginInfo(renderPass,
+                           targets.framebuffers[idx],
+                           { { 0, 0 }, swapchain->imageExtent },
+                           4,
+                           clearValues);
+
+  vkCmdBeginRenderPass(
+    commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+  // viewport and scissor are dynamic in every pipeline and stay set for
+  // both subpasses
+  VkViewport viewport = { 0.0f,
+                          0.0f,
+                          (float)swapchain->imageExtent.width,
+                          (float)swapchain->imageExtent.height,
+                          0.0f,
+                          1.0f };
+  VkRect2D scissor = { { 0, 0 }, swapchain->imageExtent };
+  vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+  vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+  // subpass 0: stencil
   {
-    VkClearValue clearValue = { 0.0f, 0.0f };
+    vkCmdBindVertexBuffers(
+      commandBuffer, 1, 1, &instanceBuffer, &instanceOffset);
+
+    VkBuffer dynamicVertexBuffer = dynamicVertexRing->GetBuffer();
+    VkDeviceSize dynamicVertexOffset = dynamicVertexRing->GetFrameOffset();
+    vkCmdBindVertexBuffers(commandBuffer,
+                           0,
+                           1,
+                           &dynamicVertexBuffer,
+                           &dynamicVertexOffset);
+
+    recordSegments(
+      commandBuffer, prePipeline, preGlyphPipeline, viewTransform);
+
+    // edge coverage of the same segments, stencil is left alone
+    if (analyticCoverage) {
+      recordSegments(commandBuffer,
+                     preCoveragePipeline,
+                     preGlyphCoveragePipeline,
+                     viewTransform);
+    }
 
-    VkRenderPassBeginInfo renderPassInfo =
-      vkiRenderPassBeginInfo(renderPassPre,
-                             framebufferPre,
-                             { { 0, 0 }, swapchain->imageExtent },
-                             1,
-                             &clearValue);
+    VkDeviceSize vbufferOffset = 0;
 
-    vkCmdBeginRenderPass(
-      commandBuffers[idx], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    // fans pushed as triangle fans
+    vkCmdBindPipeline(commandBuffer,
+                      VK_PIPELINE_BIND_POINT_GRAPHICS,
+                      preFanPipeline->pipeline);
 
-    VkDeviceSize vbufferOffset =
-      curDynVertexBufferPartition * DYN_VERTEX_BUFFER_PARTITION_SIZE;
-    vkCmdBindVertexBuffers(
-      commandBuffers[idx], 0, 1, &dynamicVertexBuffer, &vbufferOffset);
+    vkCmdPushConstants(commandBuffer,
+                       preFanPipeline->pipelineLayout,
+                       VK_SHADER_STAGE_VERTEX_BIT,
+                       0,
+                       sizeof(glm::mat4),
+                       &identity);
+
+    recordIndirectDraws(commandBuffer, INDIRECT_REGION_FANS);
+
+    if (numIndirectDraws[INDIRECT_REGION_GLYPH_FANS] > 0) {
+      vbufferOffset = 0;
+      vkCmdBindVertexBuffers(
+        commandBuffer,
+        0,
+        1,
+        &glyphHeaps[GLYPH_HEAP_FAN_VERTICES].buffer,
+        &vbufferOffset);
+
+      vkCmdPushConstants(commandBuffer,
+                         preFanPipeline->pipelineLayout,
+                         VK_SHADER_STAGE_VERTEX_BIT,
+                         0,
+                         sizeof(glm::mat4),
+                         &viewTransform);
 
-    vkCmdBindPipeline(commandBuffers[idx],
-                      VK_PIPELINE_BIND_POINT_GRAPHICS,
-                      prePipeline->pipeline);
+      recordIndirectDraws(commandBuffer, INDIRECT_REGION_GLYPH_FANS);
+    }
 
-    vkCmdDraw(commandBuffers[idx], numSegments * 3, 1, 0, 0);
+    // fans pushed as indexed triangle lists
+    if (numFanIndices > 0 ||
+        numIndirectDraws[INDIRECT_REGION_GLYPH_FAN_LISTS] > 0) {
+      vkCmdBindPipeline(commandBuffer,
+                        VK_PIPELINE_BIND_POINT_GRAPHICS,
+                        preFanListPipeline->pipeline);
+    }
 
-    vbufferOffset =
-      curDynVertexBufferPartition * DYN_VERTEX_BUFFER_PARTITION_SIZE +
-      numSegments * sizeof(Segment);
+    if (numFanIndices > 0) {
+      vkCmdBindVertexBuffers(commandBuffer,
+                             0,
+                             1,
+                             &dynamicVertexBuffer,
+                             &dynamicVertexOffset);
 
-    vkCmdBindVertexBuffers(
-      commandBuffers[idx], 0, 1, &dynamicVertexBuffer, &vbufferOffset);
+      vkCmdBindIndexBuffer(commandBuffer,
+                           fanIndexRing->GetBuffer(),
+                           fanIndexRing->GetFrameOffset(),
+                           VK_INDEX_TYPE_UINT32);
 
-    vkCmdBindPipeline(commandBuffers[idx],
-                      VK_PIPELINE_BIND_POINT_GRAPHICS,
-                      preFanPipeline->pipeline);
+      vkCmdPushConstants(commandBuffer,
+                         preFanListPipeline->pipelineLayout,
+                         VK_SHADER_STAGE_VERTEX_BIT,
+                         0,
+                         sizeof(glm::mat4),
+                         &identity);
 
-    for (int i = 0; i < fanBegin.size(); ++i) {
-      int numFanVerts = fanEnd[i] - fanBegin[i];
-      vkCmdDraw(commandBuffers[idx], numFanVerts, 1, fanBegin[i], 0);
+      vkCmdDrawIndexed(commandBuffer, numFanIndices, 1, 0, 0, 0);
     }
 
-    vkCmdEndRenderPass(commandBuffers[idx]);
+    if (numIndirectDraws[INDIRECT_REGION_GLYPH_FAN_LISTS] > 0) {
+      vbufferOffset = 0;
+      vkCmdBindVertexBuffers(
+        commandBuffer,
+        0,
+        1,
+        &glyphHeaps[GLYPH_HEAP_FAN_VERTICES].buffer,
+        &vbufferOffset);
+
+      vkCmdBindIndexBuffer(
+        commandBuffer,
+        glyphHeaps[GLYPH_HEAP_FAN_INDICES].buffer,
+        0,
+        VK_INDEX_TYPE_UINT32);
+
+      vkCmdPushConstants(commandBuffer,
+                         preFanListPipeline->pipelineLayout,
+                         VK_SHADER_STAGE_VERTEX_BIT,
+                         0,
+                         sizeof(glm::mat4),
+                         &viewTransform);
+
+      recordIndirectDraws(commandBuffer, INDIRECT_REGION_GLYPH_FAN_LISTS);
+    }
   }
 
-  // postpass
+  vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+
+  // subpass 1: cover
   {
-    VkClearValue clearValues[] = { { 0.0f, 0.0f, 0.0f, 0.0f }, { 0.f, 0 } };
-    VkRenderPassBeginInfo renderPassInfo =
-      vkiRenderPassBeginInfo(renderPassPost,
-                             framebuffersPost[idx],
-                             { { 0, 0 }, swapchain->imageExtent },
-                             2,
-                             clearValues);
+    VkDeviceSize vbufferOffset = 0;
+    vkCmdBindVertexBuffers(
+      commandBuffer, 0, 1, &vertexBuffer, &vbufferOffset);
+    vkCmdBindVertexBuffers(
+      commandBuffer, 1, 1, &instanceBuffer, &instanceOffset);
+
+    if (analyticCoverage) {
+      vkCmdBindDescriptorSets(commandBuffer,
+                              VK_PIPELINE_BIND_POINT_GRAPHICS,
+                              coverInsidePipeline->pipelineLayout,
+                              0,
+                              1,
+                              &targets.coverageDescriptorSet,
+                              0,
+                              nullptr);
+
+      // outside first, the inside covers mark their pixels done
+      recordCovers(commandBuffer, coverOutsidePipeline, viewTransform, false);
+      recordCovers(commandBuffer, coverInsidePipeline, viewTransform, true);
+    } else {
+      recordCovers(commandBuffer, postPipeline, viewTransform, true);
+    }
+  }
+
+  vkCmdEndRenderPass(commandBuffer);
+
+  if (timestampQueryPool != VK_NULL_HANDLE) {
+    vkCmdWriteTimestamp(commandBuffer,
+                        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                        timestampQueryPool,
+                        2 * slot + 1);
+  }
+
+  ASSERT_VK_SUCCESS(vkEndCommandBuffer(commandBuffer));
+}
+
+void
+Renderer::recordSegments(VkCommandBuffer commandBuffer,
+                         GraphicsPipeline* pipeline,
+                         GraphicsPipeline* glyphPipeline,
+                         const glm::mat4& viewTransform)
+{
+  glm::mat4 identity(1.f);
+
+  vkCmdBindPipeline(
+    commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->pipeline);
+
+  vkCmdPushConstants(commandBuffer,
+                     pipeline->pipelineLayout,
+                     VK_SHADER_STAGE_VERTEX_BIT,
+                     0,
+                     sizeof(glm::mat4),
+                     &identity);
 
-    vkCmdBeginRenderPass(
-      commandBuffers[idx], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+  recordIndirectDraws(commandBuffer, INDIRECT_REGION_SEGMENTS);
 
+  if (numIndirectDraws[INDIRECT_REGION_GLYPH_SEGMENTS] > 0) {
     VkDeviceSize vbufferOffset = 0;
-    vkCmdBindVertexBuffers(
-      commandBuffers[idx], 0, 1, &vertexBuffer, &vbufferOffset);
+    vkCmdBindVertexBuffers(commandBuffer,
+                           0,
+                           1,
+                           &glyphHeaps[GLYPH_HEAP_SEGMENTS].buffer,
+                           &vbufferOffset);
 
-    vkCmdBindPipeline(commandBuffers[idx],
+    vkCmdBindPipeline(commandBuffer,
                       VK_PIPELINE_BIND_POINT_GRAPHICS,
-                      postPipeline->pipeline);
+                      glyphPipeline->pipeline);
+
+    vkCmdPushConstants(commandBuffer,
+                       glyphPipeline->pipelineLayout,
+                       VK_SHADER_STAGE_VERTEX_BIT,
+                       0,
+                       sizeof(glm::mat4),
+                       &viewTransform);
 
-    vkCmdDraw(commandBuffers[idx], 6, 1, 0, 0);
+    recordIndirectDraws(commandBuffer, INDIRECT_REGION_GLYPH_SEGMENTS);
 
-    vkCmdEndRenderPass(commandBuffers[idx]);
+    // pushed geometry is drawn from the dynamic ring again afterwards
+    VkBuffer dynamicVertexBuffer = dynamicVertexRing->GetBuffer();
+    VkDeviceSize dynamicVertexOffset = dynamicVertexRing->GetFrameOffset();
+    vkCmdBindVertexBuffers(
+      commandBuffer, 0, 1, &dynamicVertexBuffer, &dynamicVertexOffset);
   }
+}
 
-  ASSERT_VK_SUCCESS(vkEndCommandBuffer(commandBuffers[idx]));
+void
+Renderer::recordCovers(VkCommandBuffer commandBuffer,
+                       GraphicsPipeline* pipeline,
+                       const glm::mat4& viewTransform,
+                       bool inside)
+{
+  glm::mat4 identity(1.f);
+  uint32_t insideFlag = inside;
+
+  vkCmdBindPipeline(
+    commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->pipeline);
+
+  vkCmdPushConstants(commandBuffer,
+                     pipeline->pipelineLayout,
+                     VK_SHADER_STAGE_FRAGMENT_BIT,
+                     sizeof(glm::mat4),
+                     sizeof(uint32_t),
+                     &insideFlag);
+
+  // the cover quad is the unit box of every glyph instance, glyph
+  // geometry is normalized to its bounding box
+  if (numGlyphCovers > 0) {
+    vkCmdPushConstants(commandBuffer,
+                       pipeline->pipelineLayout,
+                       VK_SHADER_STAGE_VERTEX_BIT,
+                       0,
+                       sizeof(glm::mat4),
+                       &viewTransform);
+
+    vkCmdDraw(commandBuffer, 6, numGlyphCovers, 0, 1);
+  }
+
+  if (pushedCoverInstance > 0) {
+    vkCmdPushConstants(commandBuffer,
+                       pipeline->pipelineLayout,
+                       VK_SHADER_STAGE_VERTEX_BIT,
+                       0,
+                       sizeof(glm::mat4),
+                       &identity);
+
+    vkCmdDraw(commandBuffer, 6, 1, 0, pushedCoverInstance);
+  }
 }
 
 void
 Renderer::drawFrame()
 {
-  uint32_t nextImageIdx = -1;
-  ASSERT_VK_SUCCESS(vkAcquireNextImageKHR(device,
-                                          swapchain->handle,
-                                          UINT64_MAX,
-                                          imageAvailableSemaphore,
-                                          VK_NULL_HANDLE,
-                                          &nextImageIdx));
+  uint32_t nextImageIdx = AcquireImage();
+
+  // instances 1.. are glyphs, pushed geometry gets a cover instance of its
+  // own from the bounds of its points
+  numGlyphCovers = numGlyphInstances - 1;
+  pushedCoverInstance = 0;
+  if (pushedBoundsMin.x <= pushedBoundsMax.x) {
+    GlyphInstance cover = { 0.5f * (pushedBoundsMin + pushedBoundsMax),
+                            0.5f * (pushedBoundsMax - pushedBoundsMin) };
+    pushedCoverInstance = drawInstance({ cover, cover });
+  }
 
   recordCommandBuffer(nextImageIdx);
 
-  VkPipelineStageFlags waitStages[] = {
-    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
-  };
-  VkSubmitInfo submitInfo = vkiSubmitInfo(1,
-                                          &imageAvailableSemaphore,
-                                          waitStages,
-                                          1,
-                                          &commandBuffers[nextImageIdx],
-                                          1,
-                                          &renderFinishedSemaphore);
-  ASSERT_VK_SUCCESS(vkQueueSubmit(queue, 1, &submitInfo, fences[nextImageIdx]));
+  // uploads of this frame go first, same queue
+  uploadManager->Flush();
+  PresentImage(nextImageIdx);
+
+  // the ring slots of the next frame were used framesInFlight frames ago
+  if (frameSerial > framesInFlight)
+    WaitForFrame(frameSerial - framesInFlight);
 
-  VkPresentInfoKHR presentInfo = vkiPresentInfoKHR(
-    1, &renderFinishedSemaphore, 1, &swapchain->handle, &nextImageIdx, nullptr);
-  ASSERT_VK_SUCCESS(vkQueuePresentKHR(queue, &presentInfo));
+  dynamicVertexRing->NextFrame();
+  fanIndexRing->NextFrame();
+  instanceRing->NextFrame();
+  for (auto ring : indirectRings) {
+    ring->NextFrame();
+  }
 
-  // reset offsets / counts for the dynamic vertex buffer after each frame
-  numSegments = 0;
-  totalNumFanVerts = 0;
-  fanBegin.clear();
-  fanEnd.clear();
+  beginFrame();
+}
+
+void
+Renderer::readFrame(std::vector<uint8_t>& pixels)
+{
+  ASSERT_TRUE(frameSerial > 1);
 
-  curDynVertexBufferPartition = (curDynVertexBufferPartition + 1) % 2;
+  const Frame& frame = frames[(frameSerial - 1) % framesInFlight];
+  ReadbackImage(frame.imageIdx, pixels);
+}
+
+void
+Renderer::beginFrame()
+{
+  numFanIndices = 0;
+  numGlyphInstances = 0;
+  pushedBoundsMin = glm::vec2(FLT_MAX);
+  pushedBoundsMax = glm::vec2(-FLT_MAX);
+  for (auto& numDraws : numIndirectDraws) {
+    numDraws = 0;
+  }
+  for (auto& draws : directDraws) {
+    draws.clear();
+  }
+  directIndexedDraws.clear();
+
+  // identity placement for pushSegments / pushFan geometry
+  GlyphInstance identity = { { 0.f, 0.f }, { 1.f, 1.f } };
+  drawInstance({ identity, identity });
+}
+
+uint32_t
+Renderer::drawInstance(const InstanceData& instance)
+{
+  VkDeviceSize offset =
+    instanceRing->Allocate(sizeof(InstanceData), sizeof(InstanceData));
+  *(InstanceData*)instanceRing->GetPointer(offset) = instance;
+
+  return numGlyphInstances++;
+}
+
+void
+Renderer::printBufferStats()
+{
+  struct
+  {
+    const char* name;
+    FrameRingBuffer* ring;
+  } rings[] = { { "vertices", dynamicVertexRing },
+                { "fan indices", fanIndexRing },
+                { "instances", instanceRing },
+                { "segment draws", indirectRings[INDIRECT_REGION_SEGMENTS] },
+                { "glyph segment draws",
+                  indirectRings[INDIRECT_REGION_GLYPH_SEGMENTS] },
+                { "fan draws", indirectRings[INDIRECT_REGION_FANS] },
+                { "glyph fan draws",
+                  indirectRings[INDIRECT_REGION_GLYPH_FANS] },
+                { "glyph fan list draws",
+                  indirectRings[INDIRECT_REGION_GLYPH_FAN_LISTS] } };
+
+  printf("%u frames in flight, synchronized with %s\n",
+         framesInFlight,
+         frameTimeline != VK_NULL_HANDLE ? "a timeline semaphore" : "fences");
+  for (const auto& r : rings) {
+    printf("%-20s high-water %8llu / %8llu bytes per frame, grown %u times\n",
+           r.name,
+           (unsigned long long)r.ring->GetHighWaterMark(),
+           (unsigned long long)r.ring->GetFrameSize(),
+           r.ring->GetGrowCount());
+  }
+
+  DeviceMemoryAllocator::Stats memoryStats = memoryAllocator->GetStats();
+  printf("device memory %u blocks, %u allocations, %llu bytes used, "
+         "%llu bytes wasted\n",
+         memoryStats.blockCount,
+         memoryStats.allocationCount,
+         (unsigned long long)memoryStats.usedBytes,
+         (unsigned long long)memoryStats.wastedBytes);
+
+  printf("upload staging high-water %llu / %llu bytes, %u stalls\n",
+         (unsigned long long)uploadManager->GetStagingHighWaterMark(),
+         (unsigned long long)uploadManager->GetStagingSize(),
+         uploadManager->GetStallCount());
+
+  const char* heapNames[GLYPH_HEAP_COUNT] = { "glyph segments",
+                                              "glyph fan vertices",
+                                              "glyph fan indices" };
+
+  printf("%u resident glyphs\n", (uint32_t)glyphLru.size());
+  for (uint32_t i = 0; i < GLYPH_HEAP_COUNT; ++i) {
+    const RangeAllocator* allocator = glyphHeaps[i].allocator;
+    printf("%-20s heap %8llu / %8llu elements used, largest free %llu\n",
+           heapNames[i],
+           (unsigned long long)(allocator->GetSize() -
+                                allocator->GetFreeCount()),
+           (unsigned long long)allocator->GetSize(),
+           (unsigned long long)allocator->GetLargestFreeRange());
+  }
 }
 
 void
 Renderer::pushSegments(const std::vector<Segment>& segments)
 {
-  size_t offset =
-    curDynVertexBufferPartition * DYN_VERTEX_BUFFER_PARTITION_SIZE +
-    numSegments * sizeof(Segment);
-  size_t size = segments.size() * sizeof(Segment);
+  pushSegments(segments.data(), static_cast<uint32_t>(segments.size()));
+}
 
-  ASSERT_TRUE(offset + size < DYN_VERTEX_BUFFER_SIZE);
+void
+Renderer::pushSegments(const Segment* segments, uint32_t count)
+{
+  size_t size = count * sizeof(Segment);
+  VkDeviceSize offset = dynamicVertexRing->Allocate(size, sizeof(Segment));
+
+  memcpy(dynamicVertexRing->GetPointer(offset), segments, size);
+
+  for (uint32_t i = 0; i < count; ++i) {
+    extendPushedBounds(segments[i].p0);
+    extendPushedBounds(segments[i].p1);
+    extendPushedBounds(segments[i].p2);
+  }
+
+  commitSegments(offset, count);
+}
 
-  memcpy(hostDynamicVertexBuffer + offset, segments.data(), size);
-  numSegments += static_cast<uint32_t>(segments.size());
+void
+Renderer::commitSegments(VkDeviceSize offset, uint32_t count)
+{
+  pushIndirectDraw(INDIRECT_REGION_SEGMENTS,
+                   VkDrawIndirectCommand{
+                     count * 3, 1, uint32_t(offset / sizeof(Vertex)), 0 });
+}
+
+void
+Renderer::extendPushedBounds(const glm::vec2& point)
+{
+  pushedBoundsMin = glm::min(pushedBoundsMin, point);
+  pushedBoundsMax = glm::max(pushedBoundsMax, point);
 }
 
 void
 Renderer::pushFan(const std::vector<glm::vec3>& fan)
 {
-  size_t offset =
-    curDynVertexBufferPartition * DYN_VERTEX_BUFFER_PARTITION_SIZE +
-    numSegments * sizeof(Segment) + totalNumFanVerts * sizeof(glm::vec3);
+  pushFan(fan.data(), static_cast<uint32_t>(fan.size()));
+}
 
-  size_t size = fan.size() * sizeof(glm::vec3);
-  ASSERT_TRUE(offset + size < DYN_VERTEX_BUFFER_SIZE);
+void
+Renderer::pushFan(const glm::vec3* fan, uint32_t count)
+{
+  size_t size = count * sizeof(glm::vec3);
+  VkDeviceSize offset = dynamicVertexRing->Allocate(size, sizeof(glm::vec3));
 
-  memcpy(hostDynamicVertexBuffer + offset, fan.data(), size);
+  memcpy(dynamicVertexRing->GetPointer(offset), fan, size);
+
+  for (uint32_t i = 0; i < count; ++i) {
+    extendPushedBounds(glm::vec2(fan[i]));
+  }
 
-  fanBegin.push_back(totalNumFanVerts);
-  totalNumFanVerts += static_cast<uint32_t>(fan.size());
-  fanEnd.push_back(totalNumFanVerts);
+  commitFan(offset, count);
 }
 
 void
-Renderer::OnSwapchainReinitialized()
+Renderer::commitFan(VkDeviceSize offset, uint32_t count)
+{
+  uint32_t firstVertex = uint32_t(offset / sizeof(glm::vec3));
+
+  if (fanMode == FAN_MODE_TRIANGLE_LIST) {
+    if (count < 3)
+      return;
+
+    // indices of all pushed fans are contiguous in the ring slot
+    uint32_t indexCount = 3 * (count - 2);
+    VkDeviceSize indexOffset =
+      fanIndexRing->Allocate(indexCount * sizeof(uint32_t), sizeof(uint32_t));
+
+    numFanIndices +=
+      writeFanIndices((uint32_t*)fanIndexRing->GetPointer(indexOffset),
+                      firstVertex,
+                      count);
+  } else {
+    pushIndirectDraw(INDIRECT_REGION_FANS,
+                     VkDrawIndirectCommand{ count, 1, firstVertex, 0 });
+  }
+}
+
+Renderer::ContourRenderSpan
+Renderer::allocateContour(uint32_t segmentCount, uint32_t fanCount)
+{
+  ContourRenderSpan contour = {};
+  contour.segmentCount = segmentCount;
+  contour.fanCount = fanCount;
+
+  // both allocations first, the second one may grow the ring and move the
+  // mapping
+  contour.segmentOffset = dynamicVertexRing->Allocate(
+    segmentCount * sizeof(Segment), sizeof(Segment));
+  contour.fanOffset = dynamicVertexRing->Allocate(
+    fanCount * sizeof(glm::vec3), sizeof(glm::vec3));
+
+  contour.segments =
+    (Segment*)dynamicVertexRing->GetPointer(contour.segmentOffset);
+  contour.fan = (glm::vec3*)dynamicVertexRing->GetPointer(contour.fanOffset);
+  contour.boundsMin = glm::vec2(FLT_MAX);
+  contour.boundsMax = glm::vec2(-FLT_MAX);
+
+  return contour;
+}
+
+void
+Renderer::pushSegments(const ContourRenderSpan& contour)
+{
+  extendPushedBounds(contour.boundsMin);
+  extendPushedBounds(contour.boundsMax);
+  commitSegments(contour.segmentOffset, contour.segmentCount);
+}
+
+void
+Renderer::pushFan(const ContourRenderSpan& contour)
+{
+  extendPushedBounds(contour.boundsMin);
+  extendPushedBounds(contour.boundsMax);
+  commitFan(contour.fanOffset, contour.fanCount);
+}
+
+uint32_t
+Renderer::createGlyphGeometry(const GlyphSegment* segments,
+                              uint32_t segmentCount,
+                              const glm::vec3* fanVertices,
+                              const uint32_t* fanOffsets,
+                              uint32_t contourCount,
+                              const GlyphInstance& normalization)
+{
+  glyphGeometries.push_back({});
+  uint32_t geometryId = static_cast<uint32_t>(glyphGeometries.size()) - 1;
+  glyphGeometries[geometryId].normalization = normalization;
+
+  reuploadGlyphGeometry(geometryId,
+                        segments,
+                        segmentCount,
+                        fanVertices,
+                        fanOffsets,
+                        contourCount);
+
+  return geometryId;
+}
+
+void
+Renderer::reuploadGlyphGeometry(uint32_t geometryId,
+                                const GlyphSegment* segments,
+                                uint32_t segmentCount,
+                                const glm::vec3* fanVertices,
+                                const uint32_t* fanOffsets,
+                                uint32_t contourCount)
+{
+  ASSERT_TRUE(geometryId < glyphGeometries.size());
+  ASSERT_TRUE(!glyphGeometries[geometryId].resident);
+
+  uploadGlyphGeometry(glyphGeometries[geometryId],
+                      segments,
+                      segmentCount,
+                      fanVertices,
+                      fanOffsets,
+                      contourCount);
+
+  // counts as used by the current frame, so the pending copies can not
+  // end up in a range that is handed out again before they executed
+  GlyphGeometry& geometry = glyphGeometries[geometryId];
+  geometry.resident = true;
+  geometry.lastUsedFrame = frameSerial;
+  geometry.lruIter = glyphLru.insert(glyphLru.begin(), geometryId);
+}
+
+bool
+Renderer::isGlyphGeometryResident(uint32_t geometryId) const
+{
+  ASSERT_TRUE(geometryId < glyphGeometries.size());
+  return glyphGeometries[geometryId].resident;
+}
+
+void
+Renderer::uploadGlyphGeometry(GlyphGeometry& geometry,
+                              const GlyphSegment* segments,
+                              uint32_t segmentCount,
+                              const glm::vec3* fanVertices,
+                              const uint32_t* fanOffsets,
+                              uint32_t contourCount)
+{
+  uint32_t fanVertexCount = fanOffsets[contourCount];
+
+  // all fans of the glyph as one triangle list, with the base vertex of
+  // every contour baked into its indices
+  uint32_t fanIndexCount = 0;
+  for (uint32_t i = 0; i < contourCount; ++i) {
+    uint32_t count = fanOffsets[i + 1] - fanOffsets[i];
+    if (count >= 3)
+      fanIndexCount += 3 * (count - 2);
+  }
+
+  geometry.segmentCount = segmentCount;
+  geometry.firstSegment = allocateGlyphHeap(GLYPH_HEAP_SEGMENTS, segmentCount);
+  geometry.fanVertexCount = fanVertexCount;
+  geometry.firstFanVertex =
+    allocateGlyphHeap(GLYPH_HEAP_FAN_VERTICES, fanVertexCount);
+  geometry.fanIndexCount = fanIndexCount;
+  geometry.firstFanIndex =
+    allocateGlyphHeap(GLYPH_HEAP_FAN_INDICES, fanIndexCount);
+
+  geometry.fanOffsets.resize(contourCount + 1);
+  for (uint32_t i = 0; i <= contourCount; ++i) {
+    geometry.fanOffsets[i] = geometry.firstFanVertex + fanOffsets[i];
+  }
+
+  memcpy(stageGlyphHeap(
+           GLYPH_HEAP_SEGMENTS, geometry.firstSegment, segmentCount),
+         segments,
+         segmentCount * sizeof(GlyphSegment));
+
+  memcpy(stageGlyphHeap(
+           GLYPH_HEAP_FAN_VERTICES, geometry.firstFanVertex, fanVertexCount),
+         fanVertices,
+         fanVertexCount * sizeof(glm::vec3));
+
+  uint32_t* indices = (uint32_t*)stageGlyphHeap(
+    GLYPH_HEAP_FAN_INDICES, geometry.firstFanIndex, fanIndexCount);
+  for (uint32_t i = 0; i < contourCount; ++i) {
+    indices += writeFanIndices(indices,
+                               geometry.fanOffsets[i],
+                               geometry.fanOffsets[i + 1] -
+                                 geometry.fanOffsets[i]);
+  }
+}
+
+void
+Renderer::evictGlyphGeometry(uint32_t geometryId)
 {
+  GlyphGeometry& geometry = glyphGeometries[geometryId];
+
+  // the heap ranges must not be overwritten while a frame still reads them
+  WaitForFrame(geometry.lastUsedFrame);
+
+  glyphHeaps[GLYPH_HEAP_SEGMENTS].allocator->Free(geometry.firstSegment,
+                                                  geometry.segmentCount);
+  glyphHeaps[GLYPH_HEAP_FAN_VERTICES].allocator->Free(
+    geometry.firstFanVertex, geometry.fanVertexCount);
+  glyphHeaps[GLYPH_HEAP_FAN_INDICES].allocator->Free(geometry.firstFanIndex,
+                                                     geometry.fanIndexCount);
+
+  glyphLru.erase(geometry.lruIter);
+  geometry.resident = false;
+  geometry.fanOffsets.clear();
+}
+
+uint32_t
+Renderer::allocateGlyphHeap(GlyphHeapType type, uint32_t count)
+{
+  uint64_t first = 0;
+  while (!glyphHeaps[type].allocator->Allocate(count, 1, &first)) {
+    // glyphs drawn by the frame that is being built can not be evicted,
+    // running out of those means the heap is too small for a single frame
+    ASSERT_TRUE(!glyphLru.empty());
+    uint32_t leastRecent = glyphLru.back();
+    ASSERT_TRUE(glyphGeometries[leastRecent].lastUsedFrame < frameSerial);
+
+    evictGlyphGeometry(leastRecent);
+  }
+
+  return static_cast<uint32_t>(first);
+}
+
+void*
+Renderer::stageGlyphHeap(GlyphHeapType type, uint32_t first, uint32_t count)
+{
+  GlyphHeap& heap = glyphHeaps[type];
+  VkDeviceSize size = VkDeviceSize(count) * heap.elementSize;
+
+  // the copy is recorded into the upload manager's current batch, sourced
+  // from the staging ring allocation that is returned here. the batch is
+  // flushed in front of the frame, so the glyph is resident when drawn
+  return uploadManager->StageBuffer(
+    heap.buffer, VkDeviceSize(first) * heap.elementSize, size);
+}
+
+void
+Renderer::drawGlyph(uint32_t geometryId, const GlyphInstance& instance)
+{
+  ASSERT_TRUE(geometryId < glyphGeometries.size());
+  ASSERT_TRUE(glyphGeometries[geometryId].resident);
+
+  GlyphGeometry& geometry = glyphGeometries[geometryId];
+  geometry.lastUsedFrame = frameSerial;
+  glyphLru.splice(glyphLru.begin(), glyphLru, geometry.lruIter);
+
+  // glyphs without an outline get neither draws nor a cover
+  if (geometry.segmentCount == 0)
+    return;
+
+  // p * n.scale + n.offset placed by the instance
+  const GlyphInstance& n = geometry.normalization;
+  uint32_t instanceIdx = drawInstance(
+    { instance,
+      { instance.offset + instance.scale * n.offset,
+        instance.scale * n.scale } });
+
+  pushIndirectDraw(INDIRECT_REGION_GLYPH_SEGMENTS,
+                   VkDrawIndirectCommand{ geometry.segmentCount * 3,
+                                          1,
+                                          geometry.firstSegment * 3,
+                                          instanceIdx });
+
+  if (fanMode == FAN_MODE_TRIANGLE_LIST) {
+    pushIndirectDraw(INDIRECT_REGION_GLYPH_FAN_LISTS,
+                     VkDrawIndexedIndirectCommand{ geometry.fanIndexCount,
+                                                   1,
+                                                   geometry.firstFanIndex,
+                                                   0,
+                                                   instanceIdx });
+  } else {
+    for (size_t i = 0; i + 1 < geometry.fanOffsets.size(); ++i) {
+      pushIndirectDraw(INDIRECT_REGION_GLYPH_FANS,
+                       VkDrawIndirectCommand{
+                         geometry.fanOffsets[i + 1] - geometry.fanOffsets[i],
+                         1,
+                         geometry.fanOffsets[i],
+                         instanceIdx });
+    }
+  }
+}
+
+void
+Renderer::setSampleCount(VkSampleCountFlagBits samples, bool shading)
+{
+  // highest supported power of two not above the requested count, 0
+  // means a single sample
+  uint32_t count = std::max(uint32_t(samples), 1u);
+  while (count & (count - 1)) {
+    count &= count - 1;
+  }
+
+  const auto& limits = physicalDeviceProps.props.limits;
+  VkSampleCountFlags supported = limits.framebufferColorSampleCounts &
+                                 limits.framebufferStencilSampleCounts;
+  while (count > VK_SAMPLE_COUNT_1_BIT && !(supported & count)) {
+    count >>= 1;
+  }
+  samples = VkSampleCountFlagBits(count);
+
+  shading = shading && physicalDeviceProps.features.sampleRateShading;
+
+  if (samples == sampleCount && shading == sampleShading)
+    return;
+
+  sampleCount = samples;
+  sampleShading = shading;
+  if (samples != VK_SAMPLE_COUNT_1_BIT)
+    analyticCoverage = false;
+
+  vkDeviceWaitIdle(device);
+  destroyResources();
+  createResources();
+}
+
+void
+Renderer::setFillRule(FillRule rule)
+{
+  if (rule == fillRule)
+    return;
+
+  fillRule = rule;
+
+  vkDeviceWaitIdle(device);
   destroyResources();
   createResources();
 }
+
+void
+Renderer::setAnalyticCoverage(bool enable)
+{
+  if (enable == analyticCoverage)
+    return;
+
+  analyticCoverage = enable;
+  if (enable) {
+    sampleCount = VK_SAMPLE_COUNT_1_BIT;
+    sampleShading = false;
+  }
+
+  vkDeviceWaitIdle(device);
+  destroyResources();
+  createResources();
+}
+
+void
+Renderer::OnSwapchainReinitialized()
+{
+  // pipelines only depend on the render pass, which survives a resize as
+  // long as the surface format stays the same
+  if (swapchain->surfaceFormat.format != renderPassFormat) {
+    vkDeviceWaitIdle(device);
+    destroyResources();
+    createResources();
+
+    printf("swapchain recreated, pipelines built in %.3f ms\n",
+           pipelineCreateTime);
+    return;
+  }
+
+  // frames in flight keep their targets until the old swapchain goes
+  RenderTargets retired = targets;
+  targets = {};
+  DeferDestroy([this, retired]() mutable { destroyRenderTargets(retired); });
+
+  createRenderTargets();
+}
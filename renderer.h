@@ -1,14 +1,23 @@
 #pragma once
 
-#include <glm\glm.hpp>
+#include <list>
 
+#include <glm/glm.hpp>
+#include <glm/gtc/type_precision.hpp>
+
+#include "frame_ring_buffer.h"
 #include "graphics_pipeline.h"
+#include "range_allocator.h"
+#include "upload_manager.h"
 #include "vk_base.h"
 
+// segment vertex, only the position. the curve parameters of the three
+// vertices of a segment are always (0, 0), (.5, 0), (1, 1) and derived from
+// gl_VertexIndex % 3 in preSegment.vert, so segments have to start at
+// vertex indices divisible by 3
 struct Vertex
 {
-  glm::vec3 pos;
-  glm::vec2 uv;
+  glm::vec2 pos;
 
   static VkVertexInputBindingDescription GetBindingDescription()
   {
@@ -23,17 +32,41 @@ struct Vertex
   static std::vector<VkVertexInputAttributeDescription>
   GetAttributeDescriptions()
   {
-    std::vector<VkVertexInputAttributeDescription> attributeDescriptions(2);
+    std::vector<VkVertexInputAttributeDescription> attributeDescriptions(1);
 
     attributeDescriptions[0].binding = 0;
     attributeDescriptions[0].location = 0;
-    attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+    attributeDescriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
     attributeDescriptions[0].offset = offsetof(Vertex, pos);
+    return attributeDescriptions;
+  }
+};
 
-    attributeDescriptions[1].binding = 0;
-    attributeDescriptions[1].location = 1;
-    attributeDescriptions[1].format = VK_FORMAT_R32G32_SFLOAT;
-    attributeDescriptions[1].offset = offsetof(Vertex, uv);
+// segment vertex of resident glyph geometry, in the stored glyph point
+// units, see QuantizeGlyphPoints. drawn with preGlyphSegment.vert
+struct GlyphVertex
+{
+  glm::i16vec2 pos;
+
+  static VkVertexInputBindingDescription GetBindingDescription()
+  {
+    VkVertexInputBindingDescription bindingDescription = {};
+    bindingDescription.binding = 0;
+    bindingDescription.stride = sizeof(GlyphVertex);
+    bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+    return bindingDescription;
+  }
+
+  static std::vector<VkVertexInputAttributeDescription>
+  GetAttributeDescriptions()
+  {
+    std::vector<VkVertexInputAttributeDescription> attributeDescriptions(1);
+
+    attributeDescriptions[0].binding = 0;
+    attributeDescriptions[0].location = 0;
+    attributeDescriptions[0].format = VK_FORMAT_R16G16_SINT;
+    attributeDescriptions[0].offset = offsetof(GlyphVertex, pos);
     return attributeDescriptions;
   }
 };
@@ -65,46 +98,327 @@ struct SimpleVertex
   }
 };
 
+// per-instance placement of resident glyph geometry, applied in the vertex
+// shader before the aspect correcting view transform
+struct GlyphInstance
+{
+  glm::vec2 offset;
+  glm::vec2 scale;
+};
+
+// instance ring entry. resident glyph segments are stored in glyph point
+// units and drawn with pointPlacement, the placement with the glyph's
+// normalization folded in. everything else is in normalized glyph space
+// and drawn with placement
+struct InstanceData
+{
+  GlyphInstance placement;
+  GlyphInstance pointPlacement;
+
+  static VkVertexInputBindingDescription GetBindingDescription()
+  {
+    VkVertexInputBindingDescription bindingDescription = {};
+    bindingDescription.binding = 1;
+    bindingDescription.stride = sizeof(InstanceData);
+    bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+    return bindingDescription;
+  }
+
+  // offset and scale of placement or pointPlacement
+  static std::vector<VkVertexInputAttributeDescription>
+  GetAttributeDescriptions(uint32_t firstLocation, bool points)
+  {
+    std::vector<VkVertexInputAttributeDescription> attributeDescriptions(2);
+    uint32_t base = points ? offsetof(InstanceData, pointPlacement)
+                           : offsetof(InstanceData, placement);
+
+    attributeDescriptions[0].binding = 1;
+    attributeDescriptions[0].location = firstLocation;
+    attributeDescriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
+    attributeDescriptions[0].offset = base + offsetof(GlyphInstance, offset);
+
+    attributeDescriptions[1].binding = 1;
+    attributeDescriptions[1].location = firstLocation + 1;
+    attributeDescriptions[1].format = VK_FORMAT_R32G32_SFLOAT;
+    attributeDescriptions[1].offset = base + offsetof(GlyphInstance, scale);
+    return attributeDescriptions;
+  }
+};
+
 struct Renderer : VulkanBase
 {
 public:
-  Renderer(VulkanWindow* window);
+  Renderer(VulkanWindow* window,
+           uint32_t framesInFlight = 2,
+           bool timelineSemaphore = false);
+  // headless, renders into framesInFlight offscreen images of given extent
+  Renderer(VkExtent2D extent,
+           uint32_t framesInFlight = 2,
+           bool timelineSemaphore = false);
   ~Renderer();
 
+  // three Vertex, start, control and end point at z = 0
   struct Segment
   {
-    glm::vec3 p0;
-    glm::vec2 uv0;
+    glm::vec2 p0;
+    glm::vec2 p1;
+    glm::vec2 p2;
+  };
+
+  // segment of resident glyph geometry, three GlyphVertex
+  struct GlyphSegment
+  {
+    glm::i16vec2 p0;
+    glm::i16vec2 p1;
+    glm::i16vec2 p2;
+  };
+
+  // contour geometry allocated in place from the frame's vertex ring, so
+  // pushed contours are written without an intermediate copy or heap
+  // allocation. the pointers are invalidated by the next vertex
+  // allocation, the offsets stay valid. whoever writes the contour also
+  // fills in the bounds of what it wrote, reading mapped memory back is slow
+  struct ContourRenderSpan
+  {
+    Segment* segments;
+    uint32_t segmentCount;
+    VkDeviceSize segmentOffset;
+
+    glm::vec3* fan;
+    uint32_t fanCount;
+    VkDeviceSize fanOffset;
 
-    glm::vec3 p1;
-    glm::vec2 uv1;
+    glm::vec2 boundsMin;
+    glm::vec2 boundsMax;
+  };
 
-    glm::vec3 p2;
-    glm::vec2 uv2;
+  // how contour fans are stenciled. FAN_MODE_TRIANGLE_FAN issues one draw
+  // per contour, FAN_MODE_TRIANGLE_LIST expands every fan to an indexed
+  // triangle list so all fans go in a single indexed draw and no triangle
+  // fan support is required. takes effect for geometry pushed afterwards.
+  enum FanMode
+  {
+    FAN_MODE_TRIANGLE_FAN,
+    FAN_MODE_TRIANGLE_LIST
   };
 
-  struct ContourRenderObj
+  FanMode fanMode = FAN_MODE_TRIANGLE_FAN;
+
+  // which pixels of overlapping contours are filled. FILL_RULE_EVEN_ODD
+  // fills pixels covered an odd number of times, FILL_RULE_NONZERO fills
+  // pixels with a winding number other than 0, so overlapping contours of
+  // the same direction merge as in TrueType and composite glyphs. winding
+  // numbers are counted modulo 128. changing it recreates the pipelines
+  enum FillRule
   {
-    std::vector<Segment> segments;
-    std::vector<glm::vec3> fan;
+    FILL_RULE_EVEN_ODD,
+    FILL_RULE_NONZERO
   };
 
+  void setFillRule(FillRule rule);
+  FillRule getFillRule() const { return fillRule; }
+
+  // multisampled stencil and color attachments, resolved into the
+  // swapchain image by the cover subpass. sample shading runs the curve
+  // test of the segments per sample instead of per pixel. unsupported
+  // counts, including ones that are not a power of two, fall back to the
+  // next lower one and 0 to a single sample. changing either recreates the
+  // render pass and pipelines
+  void setSampleCount(VkSampleCountFlagBits samples, bool shading = false);
+  VkSampleCountFlagBits getSampleCount() const { return sampleCount; }
+  bool getSampleShading() const { return sampleShading; }
+
+  // anti-aliasing of curved edges at one sample per pixel. the segments
+  // write how much of each edge pixel lies across the curve to a coverage
+  // attachment, the covers blend edge pixels with it. straight edges stay
+  // aliased. excludes multisampling, enabling it resets the sample count
+  void setAnalyticCoverage(bool enable);
+  bool getAnalyticCoverage() const { return analyticCoverage; }
+
   void pushSegments(const std::vector<Segment>&);
+  void pushSegments(const Segment* segments, uint32_t count);
   void pushFan(const std::vector<glm::vec3>&);
+  void pushFan(const glm::vec3* fan, uint32_t count);
+
+  // the span variants only commit the ranges of an allocated contour
+  ContourRenderSpan allocateContour(uint32_t segmentCount, uint32_t fanCount);
+  void pushSegments(const ContourRenderSpan& contour);
+  void pushFan(const ContourRenderSpan& contour);
+
+  // uploads the geometry of a glyph to device local memory, it stays
+  // resident and is drawn with drawGlyph. segments are in glyph point
+  // units, normalization maps them to the normalized glyph space the fan is
+  // in. fan of contour i is [fanOffsets[i], fanOffsets[i + 1]). when the
+  // glyph heaps are full the least recently drawn glyphs are evicted and
+  // have to be uploaded again with reuploadGlyphGeometry before they are
+  // drawn.
+  uint32_t createGlyphGeometry(const GlyphSegment* segments,
+                               uint32_t segmentCount,
+                               const glm::vec3* fanVertices,
+                               const uint32_t* fanOffsets,
+                               uint32_t contourCount,
+                               const GlyphInstance& normalization);
+  void reuploadGlyphGeometry(uint32_t geometryId,
+                             const GlyphSegment* segments,
+                             uint32_t segmentCount,
+                             const glm::vec3* fanVertices,
+                             const uint32_t* fanOffsets,
+                             uint32_t contourCount);
+  bool isGlyphGeometryResident(uint32_t geometryId) const;
+  void drawGlyph(uint32_t geometryId, const GlyphInstance& instance);
 
   void drawFrame();
 
+  // headless only, waits for the last drawn frame and copies it into
+  // pixels as tightly packed BGRA8 rows
+  void readFrame(std::vector<uint8_t>& pixels);
+
+  // gpu time of the most recently completed frame in milliseconds, 0 if
+  // timestamps are not supported
+  double GetGpuFrameTime() const { return gpuFrameTime; }
+
+  // cpu time of the last shader module and pipeline creation in
+  // milliseconds, the whole set is rebuilt on mode changes
+  double GetPipelineCreateTime() const { return pipelineCreateTime; }
+
+  // per frame buffer high-water marks and glyph heap usage
+  void printBufferStats();
+
 private:
   virtual void OnSwapchainReinitialized();
 
-  const int DYN_VERTEX_BUFFER_SIZE = 1024 * 1024 * 2;
-  const int DYN_VERTEX_BUFFER_PARTITION_SIZE = DYN_VERTEX_BUFFER_SIZE / 2;
-  uint32_t curDynVertexBufferPartition = 0;
-  uint32_t numSegments = 0;
-  uint32_t totalNumFanVerts = 0;
+  // per frame buffers are rings with one slot per frame in flight, a slot
+  // is reused once WaitForFrame returned for the frame that used it last
+  void beginFrame();
+
+  // appends to the instance ring, returns the instance index
+  uint32_t drawInstance(const InstanceData& instance);
+
+  // initial slot sizes, the rings grow on demand
+  const uint32_t DYN_VERTEX_FRAME_SIZE = 1024 * 1024;
+  const uint32_t FAN_INDEX_FRAME_SIZE = 1024 * 1024;
+  const uint32_t INSTANCE_FRAME_SIZE = 1024 * 128;
+  const uint32_t INDIRECT_FRAME_SIZE = 1024 * 64; // per region
+
+  // triangle list indices of pushed fans
+  uint32_t numFanIndices = 0;
+
+  // the post pass only covers the bounding boxes of what was stenciled
+  // instead of the whole framebuffer
+  glm::vec2 pushedBoundsMin;
+  glm::vec2 pushedBoundsMax;
+  uint32_t numGlyphCovers = 0;
+  uint32_t pushedCoverInstance = 0; // 0 if nothing was pushed
+
+  void extendPushedBounds(const glm::vec2& point);
+
+  // draws vertex ring ranges that are already written
+  void commitSegments(VkDeviceSize offset, uint32_t count);
+  void commitFan(VkDeviceSize offset, uint32_t count);
 
-  std::vector<int> fanBegin;
-  std::vector<int> fanEnd;
+  // uploads are submitted in front of every frame
+  UploadManager* uploadManager = nullptr;
+  const uint32_t UPLOAD_STAGING_SIZE = 1024 * 1024 * 4;
+
+  // resident glyph geometry lives in device local heaps that are only
+  // written by uploads submitted in front of the frame that first draws the
+  // glyph
+  enum GlyphHeapType
+  {
+    GLYPH_HEAP_SEGMENTS,
+    GLYPH_HEAP_FAN_VERTICES,
+    GLYPH_HEAP_FAN_INDICES,
+    GLYPH_HEAP_COUNT
+  };
+
+  struct GlyphHeap
+  {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    DeviceAllocation memory;
+    uint32_t elementSize = 0;
+    RangeAllocator* allocator = nullptr; // in elements
+  };
+
+  GlyphHeap glyphHeaps[GLYPH_HEAP_COUNT];
+
+  const uint32_t GLYPH_SEGMENT_HEAP_SIZE = 1024 * 1024 * 8;
+  const uint32_t GLYPH_FAN_VERTEX_HEAP_SIZE = 1024 * 1024 * 4;
+  const uint32_t GLYPH_FAN_INDEX_HEAP_SIZE = 1024 * 1024 * 8;
+
+  struct GlyphGeometry
+  {
+    bool resident;
+    uint64_t lastUsedFrame;
+    std::list<uint32_t>::iterator lruIter;
+    GlyphInstance normalization;
+
+    uint32_t firstSegment;
+    uint32_t segmentCount;
+    uint32_t firstFanVertex;
+    uint32_t fanVertexCount;
+    std::vector<uint32_t> fanOffsets; // absolute, contourCount + 1 entries
+    uint32_t firstFanIndex;
+    uint32_t fanIndexCount;
+  };
+
+  std::vector<GlyphGeometry> glyphGeometries;
+  std::list<uint32_t> glyphLru; // resident geometry ids, most recent first
+
+  void uploadGlyphGeometry(GlyphGeometry& geometry,
+                           const GlyphSegment* segments,
+                           uint32_t segmentCount,
+                           const glm::vec3* fanVertices,
+                           const uint32_t* fanOffsets,
+                           uint32_t contourCount);
+  void evictGlyphGeometry(uint32_t geometryId);
+  uint32_t allocateGlyphHeap(GlyphHeapType type, uint32_t count);
+  void* stageGlyphHeap(GlyphHeapType type, uint32_t first, uint32_t count);
+
+  // instance 0 of every frame is the identity placement used by
+  // pushSegments / pushFan geometry
+  uint32_t numGlyphInstances = 0;
+
+  // draw commands are written straight into the mapped indirect rings while
+  // geometry is pushed, each region is submitted with one
+  // vkCmdDrawIndirect / vkCmdDrawIndexedIndirect
+  enum IndirectRegion
+  {
+    INDIRECT_REGION_SEGMENTS,
+    INDIRECT_REGION_GLYPH_SEGMENTS,
+    INDIRECT_REGION_FANS,
+    INDIRECT_REGION_GLYPH_FANS,
+    INDIRECT_REGION_GLYPH_FAN_LISTS, // indexed
+    INDIRECT_REGION_COUNT
+  };
+
+  // one stride for both command types
+  const uint32_t INDIRECT_STRIDE = sizeof(VkDrawIndexedIndirectCommand);
+  uint32_t numIndirectDraws[INDIRECT_REGION_COUNT] = {};
+
+  // without drawIndirectFirstInstance indirect commands can not select
+  // their glyph instance, the commands are kept on the cpu instead and
+  // recorded as direct draws
+  std::vector<VkDrawIndirectCommand> directDraws[INDIRECT_REGION_COUNT];
+  std::vector<VkDrawIndexedIndirectCommand> directIndexedDraws;
+
+  void pushIndirectDraw(IndirectRegion region,
+                        const VkDrawIndirectCommand& command);
+  void pushIndirectDraw(IndirectRegion region,
+                        const VkDrawIndexedIndirectCommand& command);
+  void recordIndirectDraws(VkCommandBuffer commandBuffer,
+                           IndirectRegion region);
+
+  // fan of count vertices as triangle list, returns the number of indices
+  static uint32_t writeFanIndices(uint32_t* indices,
+                                  uint32_t baseVertex,
+                                  uint32_t count);
+
+  // timestamps at begin / end of every frame slot's command buffer
+  VkQueryPool timestampQueryPool = VK_NULL_HANDLE;
+  std::vector<bool> timestampsWritten;
+  double gpuFrameTime = 0.0;
+  double pipelineCreateTime = 0.0;
 
   GraphicsPipeline* postPipeline;
   VkShaderModule postVertexShader;
@@ -114,31 +428,84 @@ private:
   VkShaderModule preVertexShader;
   VkShaderModule preFragmentShader;
 
+  // resident glyph segments
+  GraphicsPipeline* preGlyphPipeline;
+  VkShaderModule preGlyphVertexShader;
+
   GraphicsPipeline* preFanPipeline;
+  GraphicsPipeline* preFanListPipeline;
   VkShaderModule preFanVertexShader;
   VkShaderModule preFanFragmentShader;
 
-  VkBuffer vertexBuffer;
-  VkDeviceMemory vertexBufferMemory;
-
-  VkBuffer dynamicVertexBuffer;
-  VkDeviceMemory dynamicVertexBufferMemory;
+  // only with analytic coverage
+  GraphicsPipeline* preCoveragePipeline = nullptr;
+  GraphicsPipeline* preGlyphCoveragePipeline = nullptr;
+  GraphicsPipeline* coverOutsidePipeline = nullptr;
+  GraphicsPipeline* coverInsidePipeline = nullptr;
+  VkShaderModule preCoverageFragmentShader = VK_NULL_HANDLE;
+  VkShaderModule postCoverageFragmentShader = VK_NULL_HANDLE;
 
-  uint8_t* hostDynamicVertexBuffer; // will leak
-
-  VkImage depthStencilImage = VK_NULL_HANDLE;
-  VkImageView depthStencilImageView = VK_NULL_HANDLE;
-  VkDeviceMemory depthStencilImageMemory = {};
-
-  std::vector<VkFramebuffer> framebuffersPost = {};
-  VkFramebuffer framebufferPre = VK_NULL_HANDLE;
+  VkBuffer vertexBuffer;
+  DeviceAllocation vertexBufferMemory;
+
+  // pushed segments and fans
+  FrameRingBuffer* dynamicVertexRing = nullptr;
+  FrameRingBuffer* fanIndexRing = nullptr;
+  FrameRingBuffer* instanceRing = nullptr;
+  FrameRingBuffer* indirectRings[INDIRECT_REGION_COUNT] = {};
+
+  VkSampleCountFlagBits sampleCount = VK_SAMPLE_COUNT_1_BIT;
+  bool sampleShading = false;
+  bool analyticCoverage = false;
+  FillRule fillRule = FILL_RULE_EVEN_ODD;
+
+  // everything sized by the swapchain. on resize a new set is created
+  // while frames in flight still use the old one, which is destroyed with
+  // the old swapchain
+  struct RenderTargets
+  {
+    VkImage depthStencilImage = VK_NULL_HANDLE;
+    VkImageView depthStencilImageView = VK_NULL_HANDLE;
+    DeviceAllocation depthStencilImageMemory;
+
+    // only with multisampling
+    VkImage colorImage = VK_NULL_HANDLE;
+    VkImageView colorImageView = VK_NULL_HANDLE;
+    DeviceAllocation colorImageMemory;
+
+    // only with analytic coverage
+    VkImage coverageImage = VK_NULL_HANDLE;
+    VkImageView coverageImageView = VK_NULL_HANDLE;
+    DeviceAllocation coverageImageMemory;
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSet coverageDescriptorSet = VK_NULL_HANDLE;
+
+    std::vector<VkFramebuffer> framebuffers = {};
+  };
 
-  VkRenderPass renderPassPre = VK_NULL_HANDLE;
-  VkRenderPass renderPassPost = VK_NULL_HANDLE;
+  RenderTargets targets;
+  VkRenderPass renderPass = VK_NULL_HANDLE;
+  VkFormat renderPassFormat = VK_FORMAT_UNDEFINED;
 
   void recordCommandBuffer(uint32_t idx);
+  // all segment regions, resident glyph segments with glyphPipeline
+  void recordSegments(VkCommandBuffer commandBuffer,
+                      GraphicsPipeline* pipeline,
+                      GraphicsPipeline* glyphPipeline,
+                      const glm::mat4& viewTransform);
+  // glyph and pushed geometry covers, inside is pushed to the fragment stage
+  void recordCovers(VkCommandBuffer commandBuffer,
+                    GraphicsPipeline* pipeline,
+                    const glm::mat4& viewTransform,
+                    bool inside);
 
 private:
+  // render pass, pipelines and everything below
   void createResources();
   void destroyResources();
+  // targets for the current swapchain and the per image state
+  void createRenderTargets();
+  void destroyRenderTargets(RenderTargets& renderTargets);
+  void createBuffers();
+  void destroyBuffers();
 };
@@ -2,11 +2,18 @@
 #extension GL_ARB_separate_shader_objects : enable
 
 layout(location = 0) in vec3 inPos;
+layout(location = 1) in vec2 inOffset;
+layout(location = 2) in vec2 inScale;
+
+layout(push_constant) uniform PushConstants {
+	mat4 viewTransform;
+} pushConstants;
 
 out gl_PerVertex {
 	vec4 gl_Position;
 };
 
 void main() {
-	gl_Position = vec4(inPos, 1.0);
-}
\ No newline at end of file
+    vec2 pos = inPos.xy * inScale + inOffset;
+    gl_Position = pushConstants.viewTransform * vec4(pos, inPos.z, 1.0);
+}
@@ -0,0 +1,18 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(input_attachment_index = 0, set = 0, binding = 0) uniform subpassInput inEdge;
+
+layout(push_constant) uniform PushConstants {
+	layout(offset = 64) uint inside;
+} pushConstants;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+	float edge = subpassLoad(inEdge).r;
+	float coverage = pushConstants.inside != 0 ? 1.0 - edge : edge;
+	// outside pixels are kept even when empty, the stencil marks them done
+	if(pushConstants.inside != 0 && coverage <= 0.0) discard;
+	outColor = vec4(1, 1, 0, coverage);
+}
\ No newline at end of file
@@ -1,8 +1,13 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout(location = 0) in vec3 inPos;
-layout(location = 1) in vec2 inUV;
+layout(location = 0) in vec2 inPos;
+layout(location = 1) in vec2 inOffset;
+layout(location = 2) in vec2 inScale;
+
+layout(push_constant) uniform PushConstants {
+	mat4 viewTransform;
+} pushConstants;
 
 layout(location = 0) out vec2 outUV;
 
@@ -10,7 +15,11 @@ out gl_PerVertex {
 	vec4 gl_Position;
 };
 
+// curve parameters of start, control and end point of every segment
+const vec2 segmentUVs[3] = vec2[](vec2(0.0, 0.0), vec2(0.5, 0.0), vec2(1.0, 1.0));
+
 void main() {
-    gl_Position = vec4(inPos, 1.0);
-	outUV = inUV;
-}
\ No newline at end of file
+    vec2 pos = inPos * inScale + inOffset;
+    gl_Position = pushConstants.viewTransform * vec4(pos, 0.0, 1.0);
+	outUV = segmentUVs[gl_VertexIndex % 3];
+}
@@ -0,0 +1,16 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) in vec2 inUV;
+layout(location = 0) out float outCoverage;
+
+void main() {
+	// signed distance to the curve v = u^2 in pixels
+	float f = inUV.x * inUV.x - inUV.y;
+	vec2 grad = vec2(dFdx(f), dFdy(f));
+	float dist = f / max(length(grad), 1e-6);
+
+	float edge = clamp(0.5 - abs(dist), 0.0, 1.0);
+	if(edge <= 0.0) discard;
+	outCoverage = edge;
+}
\ No newline at end of file
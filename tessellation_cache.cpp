@@ -0,0 +1,178 @@
+#include "tessellation_cache.h"
+
+#include <cfloat>
+
+#include "job_system.h"
+#include "vk_utils.h"
+
+// the apex sits in the middle of the contour's bounds, so fan triangles
+// stay inside them instead of reaching from a corner of the glyph box
+static void
+appendContourFan(const Renderer::GlyphSegment* segments,
+                 uint32_t count,
+                 float z,
+                 std::vector<glm::vec3>& fan)
+{
+  glm::vec2 boundsMin(segments[0].p0);
+  glm::vec2 boundsMax(segments[0].p0);
+  for (uint32_t i = 0; i < count; ++i) {
+    glm::vec2 p1(segments[i].p1);
+    glm::vec2 p2(segments[i].p2);
+    boundsMin = glm::min(boundsMin, glm::min(p1, p2));
+    boundsMax = glm::max(boundsMax, glm::max(p1, p2));
+  }
+
+  fan.push_back(glm::vec3(0.5f * (boundsMin + boundsMax), z));
+
+  for (uint32_t i = 0; i < count; ++i) {
+    fan.push_back(glm::vec3(glm::vec2(segments[i].p0), z));
+  }
+
+  fan.push_back(glm::vec3(glm::vec2(segments[0].p0), z));
+}
+
+void
+writeContour(const int16_t* points,
+             uint32_t count,
+             const ContourTransform& transform,
+             float z,
+             Renderer::ContourRenderSpan& contour)
+{
+  uint32_t segmentCount = getContourSegmentCount(count);
+  ASSERT_TRUE(contour.segmentCount == segmentCount);
+  ASSERT_TRUE(contour.fanCount == getContourFanCount(count));
+  if (segmentCount == 0)
+    return;
+
+  transformContour(points, count, transform, contour.segments);
+
+  // fan and bounds are built from the source points, the segments were
+  // just written to mapped memory that is slow to read back
+  glm::vec2 boundsMin(FLT_MAX);
+  glm::vec2 boundsMax(-FLT_MAX);
+  for (uint32_t i = 0; i < 2 * segmentCount + 1; ++i) {
+    glm::vec2 point =
+      glm::vec2(points[2 * i], points[2 * i + 1]) * transform.scale +
+      transform.offset;
+    boundsMin = glm::min(boundsMin, point);
+    boundsMax = glm::max(boundsMax, point);
+    if (i % 2 == 0 && i < 2 * segmentCount)
+      contour.fan[1 + i / 2] = glm::vec3(point, z);
+  }
+
+  glm::vec2 first =
+    glm::vec2(points[0], points[1]) * transform.scale + transform.offset;
+  contour.fan[0] = glm::vec3(0.5f * (boundsMin + boundsMax), z);
+  contour.fan[segmentCount + 1] = glm::vec3(first, z);
+
+  contour.boundsMin = boundsMin;
+  contour.boundsMax = boundsMax;
+}
+
+void
+tessellateGlyph(const GlyphView& glyph, TessellatedGlyph& tessellated)
+{
+  tessellated.fanOffsets.push_back(0);
+
+  // the points are kept as they are stored, normalizing them is part of the
+  // instance transform
+  ContourTransform transform = getContourTransform(
+    glyph.xMin, glyph.yMin, glyph.xMax, glyph.yMax, glyph.pointScale, 1.f);
+  tessellated.normalization = { transform.offset, transform.scale };
+
+  for (uint32_t i = 0; i < glyph.contourCount; ++i) {
+    // contours need at least one segment
+    uint32_t segmentCount = getContourSegmentCount(glyph.contours[i].count);
+    if (segmentCount == 0)
+      continue;
+
+    // consecutive segments share their end and start point
+    const int16_t* p = glyph.GetContourPoints(i);
+    size_t first = tessellated.segments.size();
+    for (uint32_t j = 0; j < segmentCount; ++j, p += 4) {
+      tessellated.segments.push_back({ glm::i16vec2(p[0], p[1]),
+                                       glm::i16vec2(p[2], p[3]),
+                                       glm::i16vec2(p[4], p[5]) });
+    }
+
+    // fans are drawn in normalized glyph space
+    size_t firstFanVertex = tessellated.fanVertices.size();
+    appendContourFan(
+      &tessellated.segments[first], segmentCount, 0.f, tessellated.fanVertices);
+    for (size_t j = firstFanVertex; j < tessellated.fanVertices.size(); ++j) {
+      glm::vec3& v = tessellated.fanVertices[j];
+      v = glm::vec3(glm::vec2(v) * transform.scale + transform.offset, v.z);
+    }
+    tessellated.fanOffsets.push_back(
+      static_cast<uint32_t>(tessellated.fanVertices.size()));
+  }
+}
+
+const TessellatedGlyph&
+TessellationCache::Get(uint32_t glyphId, const GlyphView& glyph)
+{
+  auto iter = glyphs.find(glyphId);
+  if (iter != glyphs.end()) {
+    // evicted from the glyph heaps, the tessellation is still around
+    TessellatedGlyph& tessellated = iter->second;
+    if (!renderer->isGlyphGeometryResident(tessellated.geometryId)) {
+      renderer->reuploadGlyphGeometry(
+        tessellated.geometryId,
+        tessellated.segments.data(),
+        static_cast<uint32_t>(tessellated.segments.size()),
+        tessellated.fanVertices.data(),
+        tessellated.fanOffsets.data(),
+        tessellated.GetContourCount());
+    }
+    return tessellated;
+  }
+
+  TessellatedGlyph& tessellated = glyphs[glyphId];
+  tessellateGlyph(glyph, tessellated);
+  upload(tessellated);
+
+  return tessellated;
+}
+
+void
+TessellationCache::Prefetch(JobSystem& jobs,
+                            const uint32_t* glyphIds,
+                            const GlyphView* glyphViews,
+                            uint32_t count)
+{
+  // map nodes are created up front, workers only fill in their own entries
+  std::vector<const GlyphView*> views;
+  std::vector<TessellatedGlyph*> targets;
+  for (uint32_t i = 0; i < count; ++i) {
+    auto inserted = glyphs.emplace(glyphIds[i], TessellatedGlyph{});
+    if (!inserted.second)
+      continue;
+    views.push_back(&glyphViews[i]);
+    targets.push_back(&inserted.first->second);
+  }
+
+  jobs.ParallelFor(static_cast<uint32_t>(targets.size()),
+                   PREFETCH_BATCH_SIZE,
+                   [&views, &targets](uint32_t first, uint32_t last) {
+                     for (uint32_t i = first; i < last; ++i) {
+                       tessellateGlyph(*views[i], *targets[i]);
+                     }
+                   });
+
+  // the renderer is not thread safe, geometry is created in order here
+  for (auto tessellated : targets) {
+    upload(*tessellated);
+  }
+}
+
+void
+TessellationCache::upload(TessellatedGlyph& tessellated)
+{
+  tessellated.geometryId = renderer->createGlyphGeometry(
+    tessellated.segments.data(),
+    static_cast<uint32_t>(tessellated.segments.size()),
+    tessellated.fanVertices.data(),
+    tessellated.fanOffsets.data(),
+    tessellated.GetContourCount(),
+    tessellated.normalization);
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "contour_transform.h"
+#include "glyphs.h"
+#include "renderer.h"
+
+struct JobSystem;
+
+// fan vertices of a contour of count coordinates, apex, segment starts and the
+// first one repeated
+inline uint32_t
+getContourFanCount(uint32_t count)
+{
+  uint32_t segmentCount = getContourSegmentCount(count);
+  return segmentCount > 0 ? segmentCount + 2 : 0;
+}
+
+// transforms a contour and writes its segments and fan straight into a
+// Renderer::allocateContour allocation sized for it and sets its bounds.
+// nothing is allocated
+void
+writeContour(const int16_t* points,
+             uint32_t count,
+             const ContourTransform& transform,
+             float z,
+             Renderer::ContourRenderSpan& contour);
+
+// segments and fans of all contours of a glyph. segments keep the stored
+// glyph points, normalization maps them to normalized glyph space, i.e. the
+// glyph bounding box mapped to [-1, 1] with y pointing down, where the fans
+// already are
+struct TessellatedGlyph
+{
+  std::vector<Renderer::GlyphSegment> segments;
+  std::vector<glm::vec3> fanVertices;
+  GlyphInstance normalization;
+
+  // fan of contour i is [fanOffsets[i], fanOffsets[i + 1])
+  std::vector<uint32_t> fanOffsets;
+
+  // resident copy of the geometry, see Renderer::createGlyphGeometry
+  uint32_t geometryId;
+
+  uint32_t GetContourCount() const
+  {
+    return static_cast<uint32_t>(fanOffsets.size()) - 1;
+  }
+};
+
+// fills an empty tessellated glyph, cpu only and safe to run concurrently
+// for different glyphs
+void
+tessellateGlyph(const GlyphView& glyph, TessellatedGlyph& tessellated);
+
+// tessellates and uploads every glyph once, placement is applied later as a
+// per-instance transform on the gpu. glyphs evicted from the renderer's
+// glyph heaps are uploaded again from the kept tessellation.
+struct TessellationCache
+{
+  TessellationCache(Renderer* renderer)
+    : renderer(renderer)
+  {}
+
+  const TessellatedGlyph& Get(uint32_t glyphId, const GlyphView& glyph);
+
+  // tessellates the glyphs not cached yet in parallel on jobs and uploads
+  // them afterwards, for when many new glyphs show up in one frame. the
+  // views have to stay valid until it returns
+  void Prefetch(JobSystem& jobs,
+                const uint32_t* glyphIds,
+                const GlyphView* glyphViews,
+                uint32_t count);
+
+  void Clear() { glyphs.clear(); }
+
+private:
+  // glyphs per job, enough to amortize scheduling
+  static const uint32_t PREFETCH_BATCH_SIZE = 16;
+
+  Renderer* renderer;
+  std::unordered_map<uint32_t, TessellatedGlyph> glyphs;
+
+  void upload(TessellatedGlyph& tessellated);
+};
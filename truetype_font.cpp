@@ -0,0 +1,537 @@
+#include "truetype_font.h"
+
+#include <cstring>
+
+// glyf simple glyph flags
+static const uint8_t ON_CURVE_POINT = 0x01;
+static const uint8_t X_SHORT_VECTOR = 0x02;
+static const uint8_t Y_SHORT_VECTOR = 0x04;
+static const uint8_t REPEAT_FLAG = 0x08;
+static const uint8_t X_IS_SAME_OR_POSITIVE = 0x10;
+static const uint8_t Y_IS_SAME_OR_POSITIVE = 0x20;
+
+// glyf composite glyph flags
+static const uint16_t ARG_1_AND_2_ARE_WORDS = 0x0001;
+static const uint16_t ARGS_ARE_XY_VALUES = 0x0002;
+static const uint16_t WE_HAVE_A_SCALE = 0x0008;
+static const uint16_t MORE_COMPONENTS = 0x0020;
+static const uint16_t WE_HAVE_AN_X_AND_Y_SCALE = 0x0040;
+static const uint16_t WE_HAVE_A_TWO_BY_TWO = 0x0080;
+
+static const int MAX_COMPONENT_DEPTH = 8;
+
+bool
+TrueTypeFont::Open(const char* filename)
+{
+  Close();
+
+  if (!file.Open(filename))
+    return false;
+
+  uint32_t head, headSize, hhea, hheaSize, maxp, maxpSize, cmap, cmapSize;
+  uint32_t hmtxSize, locaSize;
+
+  if (!inBounds(0, 12) || !findTable("head", &head, &headSize) ||
+      !findTable("hhea", &hhea, &hheaSize) ||
+      !findTable("maxp", &maxp, &maxpSize) ||
+      !findTable("cmap", &cmap, &cmapSize) ||
+      !findTable("hmtx", &hmtx, &hmtxSize) ||
+      !findTable("loca", &loca, &locaSize) ||
+      !findTable("glyf", &glyf, &glyfSize) || headSize < 54 ||
+      hheaSize < 36 || maxpSize < 6 || cmapSize < 4) {
+    Close();
+    return false;
+  }
+
+  unitsPerEm = u16(head + 18);
+  indexToLocFormat = i16(head + 50);
+  numGlyphs = u16(maxp + 4);
+  numHMetrics = u16(hhea + 34);
+
+  uint32_t locaEntrySize = indexToLocFormat == 0 ? 2 : 4;
+  if (numGlyphs == 0 || locaSize < (numGlyphs + 1) * locaEntrySize ||
+      numHMetrics == 0 || hmtxSize < numHMetrics * 4) {
+    Close();
+    return false;
+  }
+
+  // pick a unicode cmap subtable, full repertoire (format 12) preferred over
+  // BMP only (format 4)
+  uint16_t numSubtables = u16(cmap + 2);
+  if (cmapSize < 4 + numSubtables * 8u) {
+    Close();
+    return false;
+  }
+
+  for (uint16_t i = 0; i < numSubtables; ++i) {
+    uint32_t record = cmap + 4 + i * 8;
+    uint16_t platformId = u16(record);
+    uint16_t encodingId = u16(record + 2);
+    uint32_t subtable = cmap + u32(record + 4);
+
+    bool unicode = platformId == 0 || (platformId == 3 && encodingId == 1) ||
+                   (platformId == 3 && encodingId == 10);
+    if (!unicode || !inBounds(subtable, 8))
+      continue;
+
+    uint16_t format = u16(subtable);
+    if (format == 12 && inBounds(subtable, 16) &&
+        inBounds(subtable + 16, u32(subtable + 12) * 12)) {
+      cmapSubtable = subtable;
+      cmapFormat = format;
+      break;
+    }
+    if (format == 4 && cmapFormat != 4 &&
+        inBounds(subtable, u16(subtable + 2))) {
+      cmapSubtable = subtable;
+      cmapFormat = format;
+    }
+  }
+
+  return true;
+}
+
+void
+TrueTypeFont::Close()
+{
+  file.Close();
+  decodedGlyphs.clear();
+  numGlyphs = 0;
+  unitsPerEm = 0;
+  numHMetrics = 0;
+  cmapSubtable = 0;
+  cmapFormat = 0;
+}
+
+bool
+TrueTypeFont::findTable(const char* tag, uint32_t* offset, uint32_t* size) const
+{
+  uint16_t numTables = u16(4);
+  if (!inBounds(12, numTables * 16u))
+    return false;
+
+  for (uint16_t i = 0; i < numTables; ++i) {
+    uint32_t record = 12 + i * 16;
+    if (memcmp(file.data + record, tag, 4) == 0) {
+      *offset = u32(record + 8);
+      *size = u32(record + 12);
+      return inBounds(*offset, *size);
+    }
+  }
+  return false;
+}
+
+uint32_t
+TrueTypeFont::GetGlyphIndex(uint32_t codepoint) const
+{
+  uint32_t glyphIdx = 0;
+
+  if (cmapFormat == 4) {
+    if (codepoint > 0xffff)
+      return 0;
+
+    uint32_t segCount = u16(cmapSubtable + 6) / 2;
+    uint32_t endCodes = cmapSubtable + 14;
+    uint32_t startCodes = endCodes + segCount * 2 + 2;
+    uint32_t idDeltas = startCodes + segCount * 2;
+    uint32_t idRangeOffsets = idDeltas + segCount * 2;
+
+    if (!inBounds(endCodes, segCount * 8 + 2))
+      return 0;
+
+    for (uint32_t i = 0; i < segCount; ++i) {
+      if (codepoint > u16(endCodes + i * 2))
+        continue;
+      if (codepoint < u16(startCodes + i * 2))
+        return 0;
+
+      uint16_t idRangeOffset = u16(idRangeOffsets + i * 2);
+      if (idRangeOffset == 0) {
+        glyphIdx = (codepoint + u16(idDeltas + i * 2)) & 0xffff;
+      } else {
+        uint32_t glyphIdxOffset = idRangeOffsets + i * 2 + idRangeOffset +
+                                  (codepoint - u16(startCodes + i * 2)) * 2;
+        if (!inBounds(glyphIdxOffset, 2))
+          return 0;
+        glyphIdx = u16(glyphIdxOffset);
+        if (glyphIdx != 0)
+          glyphIdx = (glyphIdx + u16(idDeltas + i * 2)) & 0xffff;
+      }
+      break;
+    }
+  } else if (cmapFormat == 12) {
+    uint32_t numGroups = u32(cmapSubtable + 12);
+    uint32_t lo = 0, hi = numGroups;
+
+    // groups are sorted by start code
+    while (lo < hi) {
+      uint32_t mid = (lo + hi) / 2;
+      uint32_t group = cmapSubtable + 16 + mid * 12;
+      if (codepoint < u32(group)) {
+        hi = mid;
+      } else if (codepoint > u32(group + 4)) {
+        lo = mid + 1;
+      } else {
+        glyphIdx = u32(group + 8) + codepoint - u32(group);
+        break;
+      }
+    }
+  }
+
+  return glyphIdx < numGlyphs ? glyphIdx : 0;
+}
+
+uint32_t
+TrueTypeFont::GetAdvanceWidth(uint32_t glyphIdx) const
+{
+  if (glyphIdx >= numGlyphs)
+    return 0;
+
+  uint32_t metricIdx = glyphIdx < numHMetrics ? glyphIdx : numHMetrics - 1;
+  return u16(hmtx + metricIdx * 4);
+}
+
+GlyphView
+TrueTypeFont::GetGlyph(uint32_t glyphIdx)
+{
+  auto iter = decodedGlyphs.find(glyphIdx);
+
+  if (iter == decodedGlyphs.end()) {
+    DecodedGlyph decoded = {};
+    uint32_t offset, size;
+
+    if (glyphIdx < numGlyphs && getGlyphRange(glyphIdx, &offset, &size) &&
+        size >= 10) {
+      decoded.xMin = i16(offset + 2);
+      decoded.yMin = i16(offset + 4);
+      decoded.xMax = i16(offset + 6);
+      decoded.yMax = i16(offset + 8);
+      decodeGlyph(glyphIdx, { 1.f, 0.f, 0.f, 1.f, 0.f, 0.f }, 0, &decoded);
+    }
+
+    // only scaled composite components lose precision here
+    CachedGlyph cached = { decoded.xMin,
+                           decoded.yMin,
+                           decoded.xMax,
+                           decoded.yMax,
+                           1.f,
+                           std::vector<int16_t>(decoded.points.size()),
+                           std::move(decoded.contours) };
+    cached.pointScale =
+      QuantizeGlyphPoints(decoded.points.data(),
+                          static_cast<uint32_t>(decoded.points.size()),
+                          cached.points.data(),
+                          nullptr);
+
+    iter = decodedGlyphs.emplace(glyphIdx, std::move(cached)).first;
+  }
+
+  const CachedGlyph& decoded = iter->second;
+
+  return { "",
+           decoded.xMin,
+           decoded.yMin,
+           decoded.xMax,
+           decoded.yMax,
+           decoded.pointScale,
+           decoded.points.data(),
+           decoded.contours.data(),
+           static_cast<uint32_t>(decoded.contours.size()) };
+}
+
+bool
+TrueTypeFont::getGlyphRange(uint32_t glyphIdx,
+                            uint32_t* offset,
+                            uint32_t* size) const
+{
+  uint32_t begin, end;
+
+  if (indexToLocFormat == 0) {
+    begin = u16(loca + glyphIdx * 2) * 2u;
+    end = u16(loca + glyphIdx * 2 + 2) * 2u;
+  } else {
+    begin = u32(loca + glyphIdx * 4);
+    end = u32(loca + glyphIdx * 4 + 4);
+  }
+
+  if (end < begin || end > glyfSize)
+    return false;
+
+  *offset = glyf + begin;
+  *size = end - begin;
+  return true;
+}
+
+void
+TrueTypeFont::decodeGlyph(uint32_t glyphIdx,
+                          const Transform& transform,
+                          int depth,
+                          DecodedGlyph* out) const
+{
+  uint32_t offset, size;
+
+  // empty glyphs, e.g. space, have no outline
+  if (glyphIdx >= numGlyphs || !getGlyphRange(glyphIdx, &offset, &size) ||
+      size < 10) {
+    return;
+  }
+
+  int16_t numContours = i16(offset);
+
+  if (numContours >= 0) {
+    decodeSimpleGlyph(offset, size, numContours, transform, out);
+  } else if (depth < MAX_COMPONENT_DEPTH) {
+    decodeCompositeGlyph(offset, size, transform, depth, out);
+  }
+}
+
+void
+TrueTypeFont::decodeSimpleGlyph(uint32_t offset,
+                                uint32_t size,
+                                int16_t numContours,
+                                const Transform& transform,
+                                DecodedGlyph* out) const
+{
+  uint32_t end = offset + size;
+  uint32_t cursor = offset + 10;
+
+  if (cursor + numContours * 2u + 2 > end)
+    return;
+
+  uint32_t endPts = cursor;
+  uint32_t numPoints =
+    numContours > 0 ? u16(endPts + (numContours - 1) * 2) + 1u : 0u;
+
+  cursor += numContours * 2;
+  cursor += 2 + u16(cursor); // skip instructions
+
+  // flags
+  std::vector<uint8_t> flags(numPoints);
+  for (uint32_t i = 0; i < numPoints;) {
+    if (cursor >= end)
+      return;
+    uint8_t flag = u8(cursor++);
+    uint32_t repeat = 1;
+    if (flag & REPEAT_FLAG) {
+      if (cursor >= end)
+        return;
+      repeat += u8(cursor++);
+    }
+    for (; repeat > 0 && i < numPoints; --repeat) {
+      flags[i++] = flag;
+    }
+  }
+
+  // coordinates, delta encoded
+  std::vector<float> xs(numPoints), ys(numPoints);
+  for (int axis = 0; axis < 2; ++axis) {
+    uint8_t shortBit = axis == 0 ? X_SHORT_VECTOR : Y_SHORT_VECTOR;
+    uint8_t sameBit = axis == 0 ? X_IS_SAME_OR_POSITIVE : Y_IS_SAME_OR_POSITIVE;
+    std::vector<float>& coords = axis == 0 ? xs : ys;
+    int32_t value = 0;
+
+    for (uint32_t i = 0; i < numPoints; ++i) {
+      if (flags[i] & shortBit) {
+        if (cursor + 1 > end)
+          return;
+        int32_t delta = u8(cursor++);
+        value += (flags[i] & sameBit) ? delta : -delta;
+      } else if (!(flags[i] & sameBit)) {
+        if (cursor + 2 > end)
+          return;
+        value += i16(cursor);
+        cursor += 2;
+      }
+      coords[i] = static_cast<float>(value);
+    }
+  }
+
+  for (uint32_t i = 0; i < numPoints; ++i) {
+    float x = xs[i], y = ys[i];
+    xs[i] = transform.a * x + transform.c * y + transform.dx;
+    ys[i] = transform.b * x + transform.d * y + transform.dy;
+  }
+
+  // expand each contour to alternating on-curve / control points
+  uint32_t first = 0;
+  for (int16_t c = 0; c < numContours; ++c) {
+    uint32_t last = u16(endPts + c * 2);
+    if (last < first || last >= numPoints)
+      return;
+
+    uint32_t count = last - first + 1;
+    if (count < 2) {
+      first = last + 1;
+      continue;
+    }
+
+    auto isOn = [&](uint32_t i) { return (flags[i] & ON_CURVE_POINT) != 0; };
+
+    // start on an on-curve point, or the implied one between last and first
+    uint32_t startIdx = 0;
+    float startX, startY;
+    bool impliedStart = false;
+    if (isOn(first)) {
+      startIdx = first;
+    } else if (isOn(last)) {
+      startIdx = last;
+    } else {
+      impliedStart = true;
+      startIdx = last;
+    }
+
+    if (impliedStart) {
+      startX = (xs[first] + xs[last]) * .5f;
+      startY = (ys[first] + ys[last]) * .5f;
+    } else {
+      startX = xs[startIdx];
+      startY = ys[startIdx];
+    }
+
+    ContourRange range = { static_cast<uint32_t>(out->points.size()), 0 };
+    std::vector<float>& p = out->points;
+
+    p.push_back(startX);
+    p.push_back(startY);
+
+    float lastOnX = startX, lastOnY = startY;
+    bool pendingCtrl = false;
+    float ctrlX = 0.f, ctrlY = 0.f;
+
+    // visit every point after the start once, then close on the start
+    for (uint32_t n = 1; n <= count; ++n) {
+      bool closing = n == count;
+      uint32_t i = first + (startIdx - first + n) % count;
+
+      bool on = closing ? true : isOn(i);
+      float x = closing ? startX : xs[i];
+      float y = closing ? startY : ys[i];
+
+      if (closing && impliedStart) {
+        // the start point itself was never visited as a control point
+        on = false;
+        x = xs[startIdx];
+        y = ys[startIdx];
+      }
+
+      if (on) {
+        if (pendingCtrl) {
+          p.push_back(ctrlX);
+          p.push_back(ctrlY);
+        } else {
+          p.push_back((lastOnX + x) * .5f);
+          p.push_back((lastOnY + y) * .5f);
+        }
+        p.push_back(x);
+        p.push_back(y);
+        lastOnX = x;
+        lastOnY = y;
+        pendingCtrl = false;
+      } else {
+        if (pendingCtrl) {
+          float midX = (ctrlX + x) * .5f;
+          float midY = (ctrlY + y) * .5f;
+          p.push_back(ctrlX);
+          p.push_back(ctrlY);
+          p.push_back(midX);
+          p.push_back(midY);
+          lastOnX = midX;
+          lastOnY = midY;
+        }
+        pendingCtrl = true;
+        ctrlX = x;
+        ctrlY = y;
+      }
+    }
+
+    if (impliedStart) {
+      p.push_back(ctrlX);
+      p.push_back(ctrlY);
+      p.push_back(startX);
+      p.push_back(startY);
+    }
+
+    range.count = static_cast<uint32_t>(p.size()) - range.first;
+    out->contours.push_back(range);
+
+    first = last + 1;
+  }
+}
+
+void
+TrueTypeFont::decodeCompositeGlyph(uint32_t offset,
+                                   uint32_t size,
+                                   const Transform& transform,
+                                   int depth,
+                                   DecodedGlyph* out) const
+{
+  uint32_t end = offset + size;
+  uint32_t cursor = offset + 10;
+  uint16_t flags = MORE_COMPONENTS;
+
+  while (flags & MORE_COMPONENTS) {
+    if (cursor + 4 > end)
+      return;
+
+    flags = u16(cursor);
+    uint16_t componentIdx = u16(cursor + 2);
+    cursor += 4;
+
+    float dx = 0.f, dy = 0.f;
+    if (flags & ARG_1_AND_2_ARE_WORDS) {
+      if (cursor + 4 > end)
+        return;
+      if (flags & ARGS_ARE_XY_VALUES) {
+        dx = i16(cursor);
+        dy = i16(cursor + 2);
+      }
+      cursor += 4;
+    } else {
+      if (cursor + 2 > end)
+        return;
+      if (flags & ARGS_ARE_XY_VALUES) {
+        dx = static_cast<int8_t>(u8(cursor));
+        dy = static_cast<int8_t>(u8(cursor + 1));
+      }
+      cursor += 2;
+    }
+    // point matching (ARGS_ARE_XY_VALUES unset) is not supported, such
+    // components are placed without offset
+
+    auto f2dot14 = [&](uint32_t o) { return i16(o) / 16384.f; };
+
+    float a = 1.f, b = 0.f, c = 0.f, d = 1.f;
+    if (flags & WE_HAVE_A_SCALE) {
+      if (cursor + 2 > end)
+        return;
+      a = d = f2dot14(cursor);
+      cursor += 2;
+    } else if (flags & WE_HAVE_AN_X_AND_Y_SCALE) {
+      if (cursor + 4 > end)
+        return;
+      a = f2dot14(cursor);
+      d = f2dot14(cursor + 2);
+      cursor += 4;
+    } else if (flags & WE_HAVE_A_TWO_BY_TWO) {
+      if (cursor + 8 > end)
+        return;
+      a = f2dot14(cursor);
+      b = f2dot14(cursor + 2);
+      c = f2dot14(cursor + 4);
+      d = f2dot14(cursor + 6);
+      cursor += 8;
+    }
+
+    // component transform followed by the parent transform
+    Transform combined = {
+      transform.a * a + transform.c * b,
+      transform.b * a + transform.d * b,
+      transform.a * c + transform.c * d,
+      transform.b * c + transform.d * d,
+      transform.a * dx + transform.c * dy + transform.dx,
+      transform.b * dx + transform.d * dy + transform.dy,
+    };
+
+    decodeGlyph(componentIdx, combined, depth + 1, out);
+  }
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "glyphs.h"
+#include "mapped_file.h"
+
+// TrueType font read from the cmap, head, hhea, hmtx, maxp, loca and glyf
+// tables. Outlines are decoded lazily on first access into the same
+// [p0, c, p1, c, p2, ...] contour layout the glyph pack uses, implied
+// on-curve points are expanded and straight lines get a midpoint control.
+// decoded outlines are kept quantized to int16, see QuantizeGlyphPoints.
+struct TrueTypeFont
+{
+  TrueTypeFont() = default;
+  TrueTypeFont(const TrueTypeFont&) = delete;
+  TrueTypeFont& operator=(const TrueTypeFont&) = delete;
+
+  bool Open(const char* filename);
+  void Close();
+  bool IsOpen() const { return file.data != nullptr; }
+
+  uint32_t GetGlyphCount() const { return numGlyphs; }
+  uint32_t GetUnitsPerEm() const { return unitsPerEm; }
+
+  // returns 0 (the missing glyph) for unmapped codepoints
+  uint32_t GetGlyphIndex(uint32_t codepoint) const;
+  uint32_t GetAdvanceWidth(uint32_t glyphIdx) const;
+
+  // the view stays valid until the font is closed
+  GlyphView GetGlyph(uint32_t glyphIdx);
+
+private:
+  struct DecodedGlyph
+  {
+    float xMin, yMin, xMax, yMax;
+    std::vector<float> points;
+    std::vector<ContourRange> contours;
+  };
+
+  struct CachedGlyph
+  {
+    float xMin, yMin, xMax, yMax;
+    float pointScale;
+    std::vector<int16_t> points;
+    std::vector<ContourRange> contours;
+  };
+
+  struct Transform
+  {
+    float a, b, c, d, dx, dy;
+  };
+
+  MappedFile file;
+
+  uint32_t numGlyphs = 0;
+  uint32_t unitsPerEm = 0;
+  uint32_t numHMetrics = 0;
+  int16_t indexToLocFormat = 0;
+
+  uint32_t cmapSubtable = 0;
+  uint16_t cmapFormat = 0;
+  uint32_t hmtx = 0;
+  uint32_t loca = 0;
+  uint32_t glyf = 0;
+  uint32_t glyfSize = 0;
+
+  std::unordered_map<uint32_t, CachedGlyph> decodedGlyphs;
+
+  bool findTable(const char* tag, uint32_t* offset, uint32_t* size) const;
+  bool getGlyphRange(uint32_t glyphIdx, uint32_t* offset, uint32_t* size) const;
+  void decodeGlyph(uint32_t glyphIdx,
+                   const Transform& transform,
+                   int depth,
+                   DecodedGlyph* out) const;
+  void decodeSimpleGlyph(uint32_t offset,
+                         uint32_t size,
+                         int16_t numContours,
+                         const Transform& transform,
+                         DecodedGlyph* out) const;
+  void decodeCompositeGlyph(uint32_t offset,
+                            uint32_t size,
+                            const Transform& transform,
+                            int depth,
+                            DecodedGlyph* out) const;
+
+  bool inBounds(uint32_t offset, uint32_t size) const
+  {
+    return offset <= file.size && size <= file.size - offset;
+  }
+  uint8_t u8(uint32_t offset) const { return file.data[offset]; }
+  uint16_t u16(uint32_t offset) const
+  {
+    return uint16_t(file.data[offset] << 8 | file.data[offset + 1]);
+  }
+  int16_t i16(uint32_t offset) const { return int16_t(u16(offset)); }
+  uint32_t u32(uint32_t offset) const
+  {
+    return uint32_t(file.data[offset]) << 24 |
+           uint32_t(file.data[offset + 1]) << 16 |
+           uint32_t(file.data[offset + 2]) << 8 |
+           uint32_t(file.data[offset + 3]);
+  }
+};
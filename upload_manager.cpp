@@ -0,0 +1,308 @@
+#include "upload_manager.h"
+
+#include <cstring>
+
+#include "vk_utils.h"
+
+UploadManager::UploadManager(VkDevice device,
+                             DeviceMemoryAllocator* allocator,
+                             VkCommandPool cmdPool,
+                             VkQueue queue,
+                             VkDeviceSize stagingSize)
+  : device(device)
+  , allocator(allocator)
+  , cmdPool(cmdPool)
+  , queue(queue)
+  , stagingSize(stagingSize)
+{
+  stagingBuffer = vkuCreateBuffer(device,
+                                  stagingSize,
+                                  VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                  VK_SHARING_MODE_EXCLUSIVE,
+                                  {});
+
+  stagingMemory = vkuAllocateBufferMemory(
+    device,
+    allocator,
+    stagingBuffer,
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+    true);
+  stagingMapped = stagingMemory.mapped;
+
+  current.ticket = 1;
+}
+
+UploadManager::~UploadManager()
+{
+  Wait(Flush());
+
+  for (auto& batch : freeBatches) {
+    vkFreeCommandBuffers(device, cmdPool, 1, &batch.cmdBuffer);
+    vkDestroyFence(device, batch.fence, nullptr);
+  }
+  if (current.cmdBuffer != VK_NULL_HANDLE) {
+    vkFreeCommandBuffers(device, cmdPool, 1, &current.cmdBuffer);
+    vkDestroyFence(device, current.fence, nullptr);
+  }
+
+  vkDestroyBuffer(device, stagingBuffer, nullptr);
+  allocator->Free(stagingMemory);
+}
+
+void
+UploadManager::BeginBatch()
+{
+  if (current.recording)
+    return;
+
+  if (current.cmdBuffer == VK_NULL_HANDLE) {
+    if (!freeBatches.empty()) {
+      Ticket ticket = current.ticket;
+      current = std::move(freeBatches.back());
+      current.ticket = ticket;
+      freeBatches.pop_back();
+    } else {
+      current.cmdBuffer = vkuAllocateCmdBuffer(
+        device, cmdPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+      current.fence = vkuCreateFence(device);
+    }
+  }
+
+  ASSERT_VK_SUCCESS(vkResetCommandBuffer(current.cmdBuffer, 0));
+  vkuBeginCmdBuffer(current.cmdBuffer,
+                    VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+  current.recording = true;
+}
+
+UploadManager::Ticket
+UploadManager::Flush()
+{
+  if (!current.recording)
+    return current.ticket - 1;
+
+  // uploads are visible to everything submitted after the batch
+  VkMemoryBarrier barrier =
+    vkiMemoryBarrier(VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_MEMORY_READ_BIT);
+
+  vkCmdPipelineBarrier(current.cmdBuffer,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                       0,
+                       1,
+                       &barrier,
+                       0,
+                       nullptr,
+                       0,
+                       nullptr);
+
+  ASSERT_VK_SUCCESS(vkEndCommandBuffer(current.cmdBuffer));
+
+  ASSERT_VK_SUCCESS(vkResetFences(device, 1, &current.fence));
+  auto submitInfo =
+    vkiSubmitInfo(0, nullptr, nullptr, 1, &current.cmdBuffer, 0, nullptr);
+  ASSERT_VK_SUCCESS(vkQueueSubmit(queue, 1, &submitInfo, current.fence));
+
+  Ticket ticket = current.ticket;
+  current.recording = false;
+  current.stagingEnd = stagingHead;
+  submitted.push_back(std::move(current));
+
+  current = Batch();
+  current.ticket = ticket + 1;
+
+  return ticket;
+}
+
+void
+UploadManager::RetireBatches(bool waitForOldest)
+{
+  if (waitForOldest && !submitted.empty()) {
+    ASSERT_VK_SUCCESS(vkWaitForFences(
+      device, 1, &submitted.front().fence, true, (uint64_t)-1));
+  }
+
+  // batches complete in submission order
+  while (!submitted.empty() &&
+         vkGetFenceStatus(device, submitted.front().fence) == VK_SUCCESS) {
+    Batch& batch = submitted.front();
+
+    for (size_t i = 0; i < batch.dedicatedBuffers.size(); ++i) {
+      vkDestroyBuffer(device, batch.dedicatedBuffers[i], nullptr);
+      allocator->Free(batch.dedicatedMemory[i]);
+    }
+    batch.dedicatedBuffers.clear();
+    batch.dedicatedMemory.clear();
+
+    if (batch.stagingEnd > stagingTail)
+      stagingTail = batch.stagingEnd;
+    completedTicket = batch.ticket;
+
+    freeBatches.push_back(std::move(batch));
+    submitted.pop_front();
+  }
+}
+
+bool
+UploadManager::IsComplete(Ticket ticket)
+{
+  if (ticket > completedTicket)
+    RetireBatches(false);
+
+  return ticket <= completedTicket;
+}
+
+void
+UploadManager::Wait(Ticket ticket)
+{
+  if (ticket >= current.ticket)
+    Flush();
+
+  while (!IsComplete(ticket)) {
+    RetireBatches(true);
+  }
+}
+
+VkDeviceSize
+UploadManager::AllocateStaging(VkDeviceSize size,
+                               VkDeviceSize alignment,
+                               VkBuffer* buffer,
+                               void** mapped)
+{
+  BeginBatch();
+
+  if (size > stagingSize) {
+    VkBuffer dedicated = vkuCreateBuffer(device,
+                                         size,
+                                         VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                         VK_SHARING_MODE_EXCLUSIVE,
+                                         {});
+
+    DeviceAllocation memory = vkuAllocateBufferMemory(
+      device,
+      allocator,
+      dedicated,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      true);
+    *mapped = memory.mapped;
+
+    current.dedicatedBuffers.push_back(dedicated);
+    current.dedicatedMemory.push_back(memory);
+
+    *buffer = dedicated;
+    return 0;
+  }
+
+  for (;;) {
+    // an empty ring starts over at its beginning
+    if (stagingHead == stagingTail) {
+      stagingHead = (stagingHead + stagingSize - 1) / stagingSize * stagingSize;
+      stagingTail = stagingHead;
+    }
+
+    uint64_t pos = stagingHead % stagingSize;
+    uint64_t aligned = (pos + alignment - 1) / alignment * alignment;
+
+    // allocations never wrap, the rest of the ring is skipped instead
+    uint64_t skip = aligned - pos;
+    if (aligned + size > stagingSize)
+      skip = stagingSize - pos;
+
+    uint64_t newHead = stagingHead + skip + size;
+    if (newHead - stagingTail <= stagingSize) {
+      stagingHead = newHead;
+      if (stagingHead - stagingTail > highWaterMark)
+        highWaterMark = stagingHead - stagingTail;
+
+      *buffer = stagingBuffer;
+      *mapped = stagingMapped + (stagingHead - size) % stagingSize;
+      return (stagingHead - size) % stagingSize;
+    }
+
+    // ring exhausted, reclaim what finished or else stall on the oldest
+    // batch. the current batch is submitted first if it holds the space.
+    RetireBatches(false);
+    if (newHead - stagingTail > stagingSize) {
+      if (submitted.empty()) {
+        Flush();
+        BeginBatch();
+      }
+      ++stallCount;
+      RetireBatches(true);
+    }
+  }
+}
+
+void*
+UploadManager::StageBuffer(VkBuffer buffer,
+                           VkDeviceSize offset,
+                           VkDeviceSize size)
+{
+  VkBuffer srcBuffer = VK_NULL_HANDLE;
+  void* mapped = nullptr;
+  VkDeviceSize srcOffset = AllocateStaging(size, 4, &srcBuffer, &mapped);
+
+  if (size > 0) {
+    VkBufferCopy copyRegion = vkiBufferCopy(srcOffset, offset, size);
+    vkCmdCopyBuffer(current.cmdBuffer, srcBuffer, buffer, 1, &copyRegion);
+  }
+
+  return mapped;
+}
+
+UploadManager::Ticket
+UploadManager::UploadBuffer(VkBuffer buffer,
+                            VkDeviceSize offset,
+                            VkDeviceSize size,
+                            const void* data)
+{
+  memcpy(StageBuffer(buffer, offset, size), data, size);
+  return current.ticket;
+}
+
+UploadManager::Ticket
+UploadManager::UploadImage(VkImage image,
+                           VkFormat format,
+                           VkExtent3D extent,
+                           VkImageLayout oldLayout,
+                           VkImageLayout newLayout,
+                           VkDeviceSize size,
+                           const void* data)
+{
+  VkBuffer srcBuffer = VK_NULL_HANDLE;
+  void* mapped = nullptr;
+  VkDeviceSize srcOffset = AllocateStaging(size, 16, &srcBuffer, &mapped);
+  memcpy(mapped, data, size);
+
+  VkImageSubresourceRange imageSubresourceRange =
+    vkiImageSubresourceRange(vkuGetImageAspectFlags(format), 0, 1, 0, 1);
+
+  vkuTransitionLayout(current.cmdBuffer,
+                      image,
+                      imageSubresourceRange,
+                      oldLayout,
+                      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+  auto bufferCopyRegion = vkiBufferImageCopy(
+    srcOffset,
+    0,
+    0,
+    vkiImageSubresourceLayers(vkuGetImageAspectFlags(format), 0, 0, 1),
+    {},
+    extent);
+
+  vkCmdCopyBufferToImage(current.cmdBuffer,
+                         srcBuffer,
+                         image,
+                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                         1,
+                         &bufferCopyRegion);
+
+  vkuTransitionLayout(current.cmdBuffer,
+                      image,
+                      imageSubresourceRange,
+                      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                      newLayout);
+
+  return current.ticket;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+#include "device_memory_allocator.h"
+
+// batches buffer and image uploads through one persistently mapped staging
+// ring. uploads are recorded into the current batch, Flush submits it with
+// a fence and the staging memory is reclaimed once the fence signaled. the
+// cpu only ever waits when the ring is exhausted or on an explicit Wait.
+// a barrier at the end of every batch makes the uploads visible to all
+// later submissions on the same queue.
+struct UploadManager
+{
+  typedef uint64_t Ticket;
+
+  UploadManager(VkDevice device,
+                DeviceMemoryAllocator* allocator,
+                VkCommandPool cmdPool,
+                VkQueue queue,
+                VkDeviceSize stagingSize);
+
+  UploadManager() = delete;
+  UploadManager(const UploadManager&) = delete;
+  UploadManager& operator=(const UploadManager& other) = delete;
+
+  ~UploadManager();
+
+  // returns staging memory that is copied to buffer at offset, it has to be
+  // filled before the next call into the upload manager
+  void* StageBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size);
+
+  Ticket UploadBuffer(VkBuffer buffer,
+                      VkDeviceSize offset,
+                      VkDeviceSize size,
+                      const void* data);
+
+  Ticket UploadImage(VkImage image,
+                     VkFormat format,
+                     VkExtent3D extent,
+                     VkImageLayout oldLayout,
+                     VkImageLayout newLayout,
+                     VkDeviceSize size,
+                     const void* data);
+
+  // ticket of the batch uploads are currently recorded into
+  Ticket GetCurrentTicket() const { return current.ticket; }
+
+  // submits the current batch, if it has any uploads
+  Ticket Flush();
+
+  bool IsComplete(Ticket ticket);
+  void Wait(Ticket ticket);
+
+  VkDeviceSize GetStagingSize() const { return stagingSize; }
+  VkDeviceSize GetStagingHighWaterMark() const { return highWaterMark; }
+  uint32_t GetStallCount() const { return stallCount; }
+
+private:
+  VkDevice device;
+  DeviceMemoryAllocator* allocator;
+  VkCommandPool cmdPool;
+  VkQueue queue;
+
+  VkBuffer stagingBuffer = VK_NULL_HANDLE;
+  DeviceAllocation stagingMemory;
+  uint8_t* stagingMapped = nullptr;
+  VkDeviceSize stagingSize;
+
+  // monotonic positions, [stagingTail, stagingHead) is in use
+  uint64_t stagingHead = 0;
+  uint64_t stagingTail = 0;
+  VkDeviceSize highWaterMark = 0;
+  uint32_t stallCount = 0;
+
+  struct Batch
+  {
+    VkCommandBuffer cmdBuffer = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+    Ticket ticket = 0;
+    bool recording = false;
+    uint64_t stagingEnd = 0;
+
+    // uploads that do not fit the ring get a staging buffer of their own
+    std::vector<VkBuffer> dedicatedBuffers;
+    std::vector<DeviceAllocation> dedicatedMemory;
+  };
+
+  Batch current;
+  std::deque<Batch> submitted;
+  std::vector<Batch> freeBatches;
+  Ticket completedTicket = 0;
+
+  void BeginBatch();
+  void RetireBatches(bool waitForOldest);
+  VkDeviceSize AllocateStaging(VkDeviceSize size,
+                               VkDeviceSize alignment,
+                               VkBuffer* buffer,
+                               void** mapped);
+};
@@ -1,20 +1,41 @@
 #include "vk_base.h"
 
 #include <algorithm> // find_if, find_first_of
+#include <cstdio>
+#include <cstring>
 
 #include "vk_init.h"
 #include "vk_utils.h"
 
-VulkanBase::VulkanBase(VulkanWindow* window)
+static const char* PIPELINE_CACHE_FILE = "pipeline_cache.bin";
+
+VulkanBase::VulkanBase(VulkanWindow* window,
+                       uint32_t framesInFlight,
+                       bool timelineSemaphore)
   : window(window)
+  , framesInFlight(framesInFlight)
+  , useTimelineSemaphore(timelineSemaphore)
+{
+  CreateSwapchainIndependentResources();
+  swapchain = CreateSwapchain();
+  CreateSwapchainDependentResources();
+}
+
+VulkanBase::VulkanBase(VkExtent2D extent,
+                       uint32_t framesInFlight,
+                       bool timelineSemaphore)
+  : headlessExtent(extent)
+  , framesInFlight(framesInFlight)
+  , useTimelineSemaphore(timelineSemaphore)
 {
   CreateSwapchainIndependentResources();
-  swapchain = new Swapchain(device, physicalDeviceProps, surface);
+  swapchain = CreateSwapchain();
   CreateSwapchainDependentResources();
 }
 
 VulkanBase::~VulkanBase()
 {
+  ReleaseRetiredSwapchains(true);
   DestroySwapchainDependentResources();
   delete swapchain;
   DestroySwapchainIndependentResources();
@@ -23,9 +44,17 @@ VulkanBase::~VulkanBase()
 void
 VulkanBase::Update()
 {
+  if (IsHeadless())
+    return;
+
   auto windowExtent = window->GetExtent();
 
-  if (windowExtent.width != swapchain->imageExtent.width ||
+  // minimized windows have no extent to create a swapchain with
+  if (windowExtent.width == 0 || windowExtent.height == 0)
+    return;
+
+  if (swapchainOutOfDate ||
+      windowExtent.width != swapchain->imageExtent.width ||
       windowExtent.height != swapchain->imageExtent.height) {
     ReinitSwapchain();
   }
@@ -34,25 +63,320 @@ VulkanBase::Update()
 void
 VulkanBase::ReinitSwapchain()
 {
-  vkDeviceWaitIdle(device);
+  for (;;) {
+    VkExtent2D extent =
+      physicalDeviceProps.GetSurfaceCapabilities().currentExtent;
+    if (extent.width != 0 && extent.height != 0)
+      break;
+    window->WaitEvents();
+  }
 
-  delete swapchain;
-  swapchain = new Swapchain(device, physicalDeviceProps, surface);
+  swapchainOutOfDate = false;
 
-  DestroySwapchainDependentResources();
+  // frames in flight still render into the old images. instead of draining
+  // the queue an empty submission behind them signals once they finished,
+  // the old swapchain is destroyed then
+  RetiredSwapchain retired = { swapchain, VK_NULL_HANDLE, {} };
+
+  VkFenceCreateInfo fenceInfo = vkiFenceCreateInfo();
+  ASSERT_VK_SUCCESS(
+    vkCreateFence(device, &fenceInfo, nullptr, &retired.fence));
+
+  VkSubmitInfo submitInfo =
+    vkiSubmitInfo(0, nullptr, 0, 0, nullptr, 0, nullptr);
+  ASSERT_VK_SUCCESS(vkQueueSubmit(queue, 1, &submitInfo, retired.fence));
+
+  retiredSwapchains.push_back(retired);
+
+  swapchain = CreateSwapchain(retired.swapchain->handle);
+
+  // presents of the old images may still wait on their semaphores
+  std::vector<VkSemaphore> semaphores = renderFinishedSemaphores;
+  DeferDestroy([this, semaphores]() {
+    for (auto semaphore : semaphores) {
+      vkDestroySemaphore(device, semaphore, nullptr);
+    }
+  });
+  renderFinishedSemaphores.clear();
   CreateSwapchainDependentResources();
 
   OnSwapchainReinitialized();
 }
 
+void
+VulkanBase::DeferDestroy(std::function<void()> deleter)
+{
+  ASSERT_TRUE(!retiredSwapchains.empty());
+  retiredSwapchains.back().deleters.push_back(std::move(deleter));
+}
+
+void
+VulkanBase::ReleaseRetiredSwapchains(bool wait)
+{
+  // retirement fences signal in submission order
+  size_t released = 0;
+  for (auto& retired : retiredSwapchains) {
+    if (wait) {
+      ASSERT_VK_SUCCESS(
+        vkWaitForFences(device, 1, &retired.fence, true, UINT64_MAX));
+    } else if (vkGetFenceStatus(device, retired.fence) != VK_SUCCESS) {
+      break;
+    }
+
+    for (auto& deleter : retired.deleters) {
+      deleter();
+    }
+    delete retired.swapchain;
+    vkDestroyFence(device, retired.fence, nullptr);
+    ++released;
+  }
+
+  retiredSwapchains.erase(retiredSwapchains.begin(),
+                          retiredSwapchains.begin() + released);
+}
+
+void
+VulkanBase::WaitForFrame(uint64_t serial)
+{
+  if (serial <= completedFrameSerial)
+    return;
+
+  ASSERT_TRUE(serial < frameSerial);
+
+  if (frameTimeline != VK_NULL_HANDLE) {
+    VkSemaphoreWaitInfoKHR waitInfo = {};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &frameTimeline;
+    waitInfo.pValues = &serial;
+    ASSERT_VK_SUCCESS(waitSemaphores(device, &waitInfo, UINT64_MAX));
+  } else if (serial + framesInFlight >= frameSerial) {
+    // the slot has not been submitted again since, older frames were waited
+    // for before their slot was reused and completedFrameSerial covers them
+    Frame& frame = frames[serial % framesInFlight];
+    ASSERT_VK_SUCCESS(
+      vkWaitForFences(device, 1, &frame.fence, true, (uint64_t)-1));
+  }
+
+  // frames finish in submission order
+  completedFrameSerial = serial;
+}
+
+VulkanBase::Swapchain*
+VulkanBase::CreateSwapchain(VkSwapchainKHR oldSwapchain)
+{
+  if (IsHeadless()) {
+    return new Swapchain(
+      device, memoryAllocator, headlessExtent, framesInFlight);
+  }
+  return new Swapchain(device, physicalDeviceProps, surface, oldSwapchain);
+}
+
+VkImageLayout
+VulkanBase::GetPresentLayout() const
+{
+  return IsHeadless() ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+                      : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+}
+
+uint32_t
+VulkanBase::AcquireImage()
+{
+  // the command buffer and semaphore of the slot are free once the frame
+  // that used them last finished
+  if (frameSerial > framesInFlight)
+    WaitForFrame(frameSerial - framesInFlight);
+
+  Frame& frame = GetFrame();
+
+  if (IsHeadless()) {
+    frame.imageIdx = headlessImageIdx;
+    headlessImageIdx = (headlessImageIdx + 1) % swapchain->imageCount;
+    return frame.imageIdx;
+  }
+
+  if (swapchainOutOfDate)
+    ReinitSwapchain();
+  ReleaseRetiredSwapchains(false);
+
+  uint32_t imageIdx = -1;
+  VkResult result = VK_ERROR_OUT_OF_DATE_KHR;
+  while (result == VK_ERROR_OUT_OF_DATE_KHR) {
+    result = vkAcquireNextImageKHR(device,
+                                   swapchain->handle,
+                                   UINT64_MAX,
+                                   frame.imageAvailableSemaphore,
+                                   VK_NULL_HANDLE,
+                                   &imageIdx);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR)
+      ReinitSwapchain();
+  }
+
+  // a suboptimal image is still rendered and presented, the swapchain is
+  // replaced afterwards
+  if (result == VK_SUBOPTIMAL_KHR)
+    swapchainOutOfDate = true;
+  else
+    ASSERT_VK_SUCCESS(result);
+
+  frame.imageIdx = imageIdx;
+  return imageIdx;
+}
+
+void
+VulkanBase::PresentImage(uint32_t imageIdx)
+{
+  Frame& frame = GetFrame();
+
+  // headless frames neither wait for an image nor get presented
+  uint32_t waitCount = IsHeadless() ? 0 : 1;
+  VkPipelineStageFlags waitStages[] = {
+    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+  };
+  uint64_t waitValues[] = { 0 };
+
+  uint32_t signalCount = 0;
+  VkSemaphore signalSemaphores[2];
+  uint64_t signalValues[2];
+  if (!IsHeadless()) {
+    signalSemaphores[signalCount] = renderFinishedSemaphores[imageIdx];
+    signalValues[signalCount++] = 0;
+  }
+  if (frameTimeline != VK_NULL_HANDLE) {
+    signalSemaphores[signalCount] = frameTimeline;
+    signalValues[signalCount++] = frameSerial;
+  }
+
+  VkSubmitInfo submitInfo = vkiSubmitInfo(waitCount,
+                                          &frame.imageAvailableSemaphore,
+                                          waitStages,
+                                          1,
+                                          &frame.commandBuffer,
+                                          signalCount,
+                                          signalSemaphores);
+
+  VkTimelineSemaphoreSubmitInfoKHR timelineInfo = {};
+  VkFence fence = VK_NULL_HANDLE;
+  if (frameTimeline != VK_NULL_HANDLE) {
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+    timelineInfo.waitSemaphoreValueCount = waitCount;
+    timelineInfo.pWaitSemaphoreValues = waitValues;
+    timelineInfo.signalSemaphoreValueCount = signalCount;
+    timelineInfo.pSignalSemaphoreValues = signalValues;
+    submitInfo.pNext = &timelineInfo;
+  } else {
+    // signaled, the slot's previous frame was waited for when acquiring
+    fence = frame.fence;
+    ASSERT_VK_SUCCESS(
+      vkWaitForFences(device, 1, &fence, true, (uint64_t)-1));
+    ASSERT_VK_SUCCESS(vkResetFences(device, 1, &fence));
+  }
+
+  ASSERT_VK_SUCCESS(vkQueueSubmit(queue, 1, &submitInfo, fence));
+  ++frameSerial;
+
+  if (IsHeadless())
+    return;
+
+  VkPresentInfoKHR presentInfo = vkiPresentInfoKHR(1,
+                                                   &signalSemaphores[0],
+                                                   1,
+                                                   &swapchain->handle,
+                                                   &imageIdx,
+                                                   nullptr);
+  VkResult result = vkQueuePresentKHR(queue, &presentInfo);
+  if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
+    swapchainOutOfDate = true;
+  else
+    ASSERT_VK_SUCCESS(result);
+}
+
+void
+VulkanBase::ReadbackImage(uint32_t imageIdx, std::vector<uint8_t>& pixels)
+{
+  ASSERT_TRUE(IsHeadless());
+
+  const VkExtent2D extent = swapchain->imageExtent;
+  const VkDeviceSize size = 4 * extent.width * extent.height;
+
+  VkBuffer buffer = vkuCreateBuffer(device,
+                                    size,
+                                    VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                    VK_SHARING_MODE_EXCLUSIVE,
+                                    {});
+  DeviceAllocation memory =
+    vkuAllocateBufferMemory(device,
+                            memoryAllocator,
+                            buffer,
+                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                              VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                            true);
+
+  // the image is in GetPresentLayout() once the frame rendering it is done
+  if (frameSerial > 1)
+    WaitForFrame(frameSerial - 1);
+
+  VkCommandBuffer commandBuffer =
+    vkuAllocateCmdBuffer(device, cmdPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+  vkuBeginCmdBuffer(commandBuffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+
+  VkBufferImageCopy region = {};
+  region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+  region.imageExtent = { extent.width, extent.height, 1 };
+  vkCmdCopyImageToBuffer(commandBuffer,
+                         swapchain->images[imageIdx],
+                         VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                         buffer,
+                         1,
+                         &region);
+
+  VkMemoryBarrier barrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                              nullptr,
+                              VK_ACCESS_TRANSFER_WRITE_BIT,
+                              VK_ACCESS_HOST_READ_BIT };
+  vkCmdPipelineBarrier(commandBuffer,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_HOST_BIT,
+                       0,
+                       1,
+                       &barrier,
+                       0,
+                       nullptr,
+                       0,
+                       nullptr);
+
+  ASSERT_VK_SUCCESS(vkEndCommandBuffer(commandBuffer));
+
+  VkFence fence = vkuCreateFence(device);
+  VkSubmitInfo submitInfo =
+    vkiSubmitInfo(0, nullptr, nullptr, 1, &commandBuffer, 0, nullptr);
+  ASSERT_VK_SUCCESS(vkQueueSubmit(queue, 1, &submitInfo, fence));
+  ASSERT_VK_SUCCESS(vkWaitForFences(device, 1, &fence, true, (uint64_t)-1));
+
+  pixels.resize(size);
+  memcpy(pixels.data(), memory.mapped, size);
+
+  vkDestroyFence(device, fence, nullptr);
+  vkFreeCommandBuffers(device, cmdPool, 1, &commandBuffer);
+  vkDestroyBuffer(device, buffer, nullptr);
+  memoryAllocator->Free(memory);
+}
+
 void
 VulkanBase::CreateSwapchainIndependentResources()
 {
   // instance
-  instanceLayers.push_back("VK_LAYER_LUNARG_standard_validation");
-  instanceExtensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
-  instanceExtensions.push_back("VK_KHR_win32_surface");
-  instanceExtensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
+  // the surface extensions come from glfw so the platform is not hardcoded,
+  // headless instances need none
+  if (!IsHeadless()) {
+    uint32_t glfwExtensionCount = 0;
+    const char** glfwExtensions =
+      glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    ASSERT_TRUE(glfwExtensions != nullptr);
+    instanceExtensions.insert(instanceExtensions.end(),
+                              glfwExtensions,
+                              glfwExtensions + glfwExtensionCount);
+  }
 
   uint32_t count;
   vkEnumerateInstanceLayerProperties(&count, nullptr);
@@ -62,6 +386,36 @@ VulkanBase::CreateSwapchainIndependentResources()
   ASSERT_VK_SUCCESS(
     vkEnumerateInstanceLayerProperties(&count, layerProperties.data()));
 
+  // validation is optional, build machines usually do not have the sdk
+  for (const auto& layer : layerProperties) {
+    if (strcmp(layer.layerName, "VK_LAYER_LUNARG_standard_validation") == 0) {
+      instanceLayers.push_back("VK_LAYER_LUNARG_standard_validation");
+      instanceExtensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
+    }
+  }
+
+  // querying the timeline semaphore feature of a 1.0 instance needs
+  // VK_KHR_get_physical_device_properties2
+  if (useTimelineSemaphore) {
+    vkEnumerateInstanceExtensionProperties(nullptr, &count, nullptr);
+    std::vector<VkExtensionProperties> extensions(count);
+    vkEnumerateInstanceExtensionProperties(nullptr, &count, extensions.data());
+
+    useTimelineSemaphore =
+      std::find_if(
+        extensions.begin(),
+        extensions.end(),
+        [](const VkExtensionProperties& extension) {
+          return strcmp(
+                   extension.extensionName,
+                   VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) == 0;
+        }) != extensions.end();
+    if (useTimelineSemaphore) {
+      instanceExtensions.push_back(
+        VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+    }
+  }
+
   VkApplicationInfo appInfo = vkiApplicationInfo(nullptr, 0, nullptr, 0, 1);
 
   VkInstanceCreateInfo instInfo =
@@ -74,10 +428,12 @@ VulkanBase::CreateSwapchainIndependentResources()
   ASSERT_VK_SUCCESS(vkCreateInstance(&instInfo, nullptr, &instance));
 
   // surface
-  surface = window->CreateSurface(instance);
+  if (!IsHeadless())
+    surface = window->CreateSurface(instance);
 
   // device
-  deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+  if (!IsHeadless())
+    deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 
   uint32_t physicalDeviceCount = 0;
   vkEnumeratePhysicalDevices(instance, &physicalDeviceCount, nullptr);
@@ -88,14 +444,15 @@ VulkanBase::CreateSwapchainIndependentResources()
   for (const auto& dev : physicalsDevices) {
     physicalDeviceProps = PhysicalDeviceProps(dev, surface);
     if (physicalDeviceProps.HasGraphicsSupport() &&
-        physicalDeviceProps.HasPresentSupport()) {
+        (IsHeadless() || physicalDeviceProps.HasPresentSupport())) {
       break;
     }
   }
 
   ASSERT_VK_VALID_HANDLE(physicalDeviceProps.handle);
-  ASSERT_TRUE(physicalDeviceProps.GetGrahicsQueueFamiliyIdx() ==
-              physicalDeviceProps.GetPresentQueueFamiliyIdx());
+  ASSERT_TRUE(IsHeadless() ||
+              physicalDeviceProps.GetGrahicsQueueFamiliyIdx() ==
+                physicalDeviceProps.GetPresentQueueFamiliyIdx());
 
   float queuePriority = 1.0f;
   uint32_t queueFamiliyIdx = physicalDeviceProps.GetGrahicsQueueFamiliyIdx();
@@ -106,7 +463,57 @@ VulkanBase::CreateSwapchainIndependentResources()
   VkPhysicalDeviceFeatures deviceFeatures = {};
   deviceFeatures.textureCompressionBC = true;
   deviceFeatures.fillModeNonSolid = true;
-  deviceFeatures.multiDrawIndirect = true;
+  deviceFeatures.multiDrawIndirect =
+    physicalDeviceProps.features.multiDrawIndirect;
+  deviceFeatures.drawIndirectFirstInstance =
+    physicalDeviceProps.features.drawIndirectFirstInstance;
+  deviceFeatures.sampleRateShading =
+    physicalDeviceProps.features.sampleRateShading;
+
+  // the timeline semaphore path needs the extension and its feature,
+  // otherwise frames are synchronized with fences
+  if (useTimelineSemaphore) {
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(
+      physicalDeviceProps.handle, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> extensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(
+      physicalDeviceProps.handle, nullptr, &extensionCount, extensions.data());
+
+    useTimelineSemaphore =
+      std::find_if(extensions.begin(),
+                   extensions.end(),
+                   [](const VkExtensionProperties& extension) {
+                     return strcmp(extension.extensionName,
+                                   VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME) ==
+                            0;
+                   }) != extensions.end();
+  }
+
+  if (useTimelineSemaphore) {
+    auto getFeatures2 = reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2KHR>(
+      vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2KHR"));
+
+    VkPhysicalDeviceTimelineSemaphoreFeaturesKHR supported = {};
+    supported.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+    VkPhysicalDeviceFeatures2KHR features2 = {};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+    features2.pNext = &supported;
+
+    useTimelineSemaphore = getFeatures2 != nullptr;
+    if (useTimelineSemaphore) {
+      getFeatures2(physicalDeviceProps.handle, &features2);
+      useTimelineSemaphore = supported.timelineSemaphore == VK_TRUE;
+    }
+  }
+
+  VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineFeatures = {};
+  timelineFeatures.sType =
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+  timelineFeatures.timelineSemaphore = VK_TRUE;
+  if (useTimelineSemaphore)
+    deviceExtensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
 
   VkDeviceCreateInfo deviceCreateInfo =
     vkiDeviceCreateInfo(1,
@@ -116,6 +523,8 @@ VulkanBase::CreateSwapchainIndependentResources()
                         static_cast<uint32_t>(deviceExtensions.size()),
                         deviceExtensions.data(),
                         &deviceFeatures);
+  if (useTimelineSemaphore)
+    deviceCreateInfo.pNext = &timelineFeatures;
 
   ASSERT_VK_SUCCESS(vkCreateDevice(
     physicalDeviceProps.handle, &deviceCreateInfo, nullptr, &device));
@@ -123,6 +532,13 @@ VulkanBase::CreateSwapchainIndependentResources()
   // queue
   vkGetDeviceQueue(device, queueFamiliyIdx, 0, &queue);
 
+  // device memory
+  memoryAllocator =
+    new DeviceMemoryAllocator(device, physicalDeviceProps.memProps);
+
+  // pipeline cache
+  CreatePipelineCache();
+
   // commandPool
   VkCommandPoolCreateInfo commandPoolCreateInfo =
     vkiCommandPoolCreateInfo(physicalDeviceProps.GetGrahicsQueueFamiliyIdx());
@@ -132,67 +548,154 @@ VulkanBase::CreateSwapchainIndependentResources()
   ASSERT_VK_SUCCESS(
     vkCreateCommandPool(device, &commandPoolCreateInfo, nullptr, &cmdPool));
 
-  // semaphores
+  // frames, fences start signaled as if a previous frame had finished
+  VkCommandBufferAllocateInfo allocateInfo =
+    vkiCommandBufferAllocateInfo(cmdPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+  VkFenceCreateInfo fenceInfo = vkiFenceCreateInfo();
+  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
   VkSemaphoreCreateInfo semaphoreCreateInfo = vkiSemaphoreCreateInfo();
 
-  ASSERT_VK_SUCCESS(vkCreateSemaphore(
-    device, &semaphoreCreateInfo, nullptr, &imageAvailableSemaphore));
+  frames.resize(framesInFlight);
+  for (auto& frame : frames) {
+    ASSERT_VK_SUCCESS(
+      vkAllocateCommandBuffers(device, &allocateInfo, &frame.commandBuffer));
+    ASSERT_VK_SUCCESS(
+      vkCreateFence(device, &fenceInfo, nullptr, &frame.fence));
+    ASSERT_VK_SUCCESS(vkCreateSemaphore(
+      device, &semaphoreCreateInfo, nullptr, &frame.imageAvailableSemaphore));
+  }
+
+  // frame timeline, counts completed frame serials
+  if (useTimelineSemaphore) {
+    VkSemaphoreTypeCreateInfoKHR typeInfo = {};
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+    typeInfo.initialValue = 0;
+
+    VkSemaphoreCreateInfo timelineInfo = vkiSemaphoreCreateInfo();
+    timelineInfo.pNext = &typeInfo;
+
+    ASSERT_VK_SUCCESS(
+      vkCreateSemaphore(device, &timelineInfo, nullptr, &frameTimeline));
 
-  ASSERT_VK_SUCCESS(vkCreateSemaphore(
-    device, &semaphoreCreateInfo, nullptr, &renderFinishedSemaphore));
+    waitSemaphores = reinterpret_cast<PFN_vkWaitSemaphoresKHR>(
+      vkGetDeviceProcAddr(device, "vkWaitSemaphoresKHR"));
+    ASSERT_TRUE(waitSemaphores != nullptr);
+  }
 }
 
 void
 VulkanBase::DestroySwapchainIndependentResources()
 {
-  vkDestroySemaphore(device, renderFinishedSemaphore, nullptr);
-  vkDestroySemaphore(device, imageAvailableSemaphore, nullptr);
+  for (auto& frame : frames) {
+    vkDestroySemaphore(device, frame.imageAvailableSemaphore, nullptr);
+    vkDestroyFence(device, frame.fence, nullptr);
+  }
+  frames.clear();
+  vkDestroySemaphore(device, frameTimeline, nullptr);
   vkDestroyCommandPool(device, cmdPool, nullptr);
+  SavePipelineCache();
+  vkDestroyPipelineCache(device, pipelineCache, nullptr);
+  delete memoryAllocator;
+  memoryAllocator = nullptr;
   vkDestroyDevice(device, nullptr);
-  vkDestroySurfaceKHR(instance, surface, nullptr);
+  if (surface != VK_NULL_HANDLE)
+    vkDestroySurfaceKHR(instance, surface, nullptr);
   vkDestroyInstance(instance, nullptr);
 }
 
 void
-VulkanBase::CreateSwapchainDependentResources()
+VulkanBase::CreatePipelineCache()
 {
-  // commandBuffers
-  commandBuffers.resize(swapchain->imageCount);
-  VkCommandBufferAllocateInfo allocateInfo = vkiCommandBufferAllocateInfo(
-    cmdPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, swapchain->imageCount);
+  std::vector<uint8_t> data;
+
+  FILE* file = fopen(PIPELINE_CACHE_FILE, "rb");
+  if (file) {
+    fseek(file, 0, SEEK_END);
+    data.resize(ftell(file));
+    fseek(file, 0, SEEK_SET);
+    if (fread(data.data(), 1, data.size(), file) != data.size())
+      data.clear();
+    fclose(file);
+  }
+
+  // drivers should reject foreign data themselves, but not all of them do.
+  // a cache of another device or driver version is dropped and rebuilt
+  // layout of VkPipelineCacheHeaderVersionOne, newer than our headers
+  struct
+  {
+    uint32_t headerSize;
+    VkPipelineCacheHeaderVersion headerVersion;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+  } header = {};
+  if (data.size() >= sizeof(header))
+    memcpy(&header, data.data(), sizeof(header));
+
+  const VkPhysicalDeviceProperties& props = physicalDeviceProps.props;
+  if (header.headerSize < sizeof(header) ||
+      header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+      header.vendorID != props.vendorID || header.deviceID != props.deviceID ||
+      memcmp(header.pipelineCacheUUID,
+             props.pipelineCacheUUID,
+             VK_UUID_SIZE) != 0)
+    data.clear();
+
+  VkPipelineCacheCreateInfo createInfo = vkiPipelineCacheCreateInfo(
+    data.size(), data.empty() ? nullptr : data.data());
 
   ASSERT_VK_SUCCESS(
-    vkAllocateCommandBuffers(device, &allocateInfo, commandBuffers.data()));
+    vkCreatePipelineCache(device, &createInfo, nullptr, &pipelineCache));
+}
 
-  // fences
-  VkFenceCreateInfo fenceInfo = vkiFenceCreateInfo();
-  fences.resize(swapchain->imageCount);
-  for (size_t i = 0; i < fences.size(); ++i) {
-    ASSERT_VK_SUCCESS(vkCreateFence(device, &fenceInfo, nullptr, &fences[i]));
+void
+VulkanBase::SavePipelineCache()
+{
+  size_t size = 0;
+  ASSERT_VK_SUCCESS(
+    vkGetPipelineCacheData(device, pipelineCache, &size, nullptr));
 
-    // put fences in a signalled state
-    VkSubmitInfo submitInfo =
-      vkiSubmitInfo(0, nullptr, 0, 0, nullptr, 0, nullptr);
+  std::vector<uint8_t> data(size);
+  ASSERT_VK_SUCCESS(
+    vkGetPipelineCacheData(device, pipelineCache, &size, data.data()));
 
-    ASSERT_VK_SUCCESS(vkQueueSubmit(queue, 1, &submitInfo, fences[i]));
+  // not being able to write the cache only costs the next startup
+  FILE* file = fopen(PIPELINE_CACHE_FILE, "wb");
+  if (file) {
+    fwrite(data.data(), 1, size, file);
+    fclose(file);
+  }
+}
+
+void
+VulkanBase::CreateSwapchainDependentResources()
+{
+  // headless frames are not presented
+  if (IsHeadless())
+    return;
+
+  VkSemaphoreCreateInfo semaphoreCreateInfo = vkiSemaphoreCreateInfo();
+  renderFinishedSemaphores.resize(swapchain->imageCount);
+  for (auto& semaphore : renderFinishedSemaphores) {
+    ASSERT_VK_SUCCESS(
+      vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &semaphore));
   }
 }
 
 void
 VulkanBase::DestroySwapchainDependentResources()
 {
-  for (auto fence : fences) {
-    vkDestroyFence(device, fence, nullptr);
+  for (auto semaphore : renderFinishedSemaphores) {
+    vkDestroySemaphore(device, semaphore, nullptr);
   }
-  vkFreeCommandBuffers(device,
-                       cmdPool,
-                       static_cast<uint32_t>(commandBuffers.size()),
-                       commandBuffers.data());
+  renderFinishedSemaphores.clear();
 }
 
 VulkanBase::Swapchain::Swapchain(VkDevice device,
                                  PhysicalDeviceProps physicalDeviceProps,
-                                 VkSurfaceKHR surface)
+                                 VkSurfaceKHR surface,
+                                 VkSwapchainKHR oldSwapchain)
   : device(device)
 {
   auto surfaceCapabilities = physicalDeviceProps.GetSurfaceCapabilities();
@@ -243,7 +746,7 @@ VulkanBase::Swapchain::Swapchain(VkDevice device,
                               VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
                               presentMode,
                               VK_TRUE,
-                              VK_NULL_HANDLE);
+                              oldSwapchain);
 
   ASSERT_VK_SUCCESS(
     vkCreateSwapchainKHR(device, &swapchainCreateInfo, nullptr, &handle));
@@ -271,13 +774,75 @@ VulkanBase::Swapchain::Swapchain(VkDevice device,
   }
 }
 
+VulkanBase::Swapchain::Swapchain(VkDevice device,
+                                 DeviceMemoryAllocator* allocator,
+                                 VkExtent2D extent,
+                                 uint32_t imageCount)
+  : device(device)
+  , allocator(allocator)
+  , imageExtent(extent)
+  , imageCount(imageCount)
+{
+  // same format a window surface would be picked with, so pipelines and
+  // render passes do not depend on the mode
+  surfaceFormat = { VK_FORMAT_B8G8R8A8_UNORM,
+                    VK_COLOR_SPACE_SRGB_NONLINEAR_KHR };
+  presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+
+  images.resize(imageCount);
+  imageViews.resize(imageCount);
+  imageMemory.resize(imageCount);
+  for (uint32_t i = 0; i < imageCount; ++i) {
+    VkImageCreateInfo imageInfo = vkiImageCreateInfo(
+      VK_IMAGE_TYPE_2D,
+      surfaceFormat.format,
+      { imageExtent.width, imageExtent.height, 1 },
+      1,
+      1,
+      VK_SAMPLE_COUNT_1_BIT,
+      VK_IMAGE_TILING_OPTIMAL,
+      VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+      VK_SHARING_MODE_EXCLUSIVE,
+      VK_QUEUE_FAMILY_IGNORED,
+      nullptr,
+      VK_IMAGE_LAYOUT_UNDEFINED);
+
+    ASSERT_VK_SUCCESS(vkCreateImage(device, &imageInfo, nullptr, &images[i]));
+
+    imageMemory[i] = vkuAllocateImageMemory(
+      device, allocator, images[i], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, true);
+
+    auto imageViewCreateInfo =
+      vkiImageViewCreateInfo(images[i],
+                             VK_IMAGE_VIEW_TYPE_2D,
+                             surfaceFormat.format,
+                             { VK_COMPONENT_SWIZZLE_IDENTITY,
+                               VK_COMPONENT_SWIZZLE_IDENTITY,
+                               VK_COMPONENT_SWIZZLE_IDENTITY,
+                               VK_COMPONENT_SWIZZLE_IDENTITY },
+                             { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 });
+
+    ASSERT_VK_SUCCESS(
+      vkCreateImageView(device, &imageViewCreateInfo, nullptr, &imageViews[i]));
+  }
+}
+
 VulkanBase::Swapchain::~Swapchain()
 {
   for (auto imageView : imageViews) {
     vkDestroyImageView(device, imageView, nullptr);
   }
 
-  vkDestroySwapchainKHR(device, handle, nullptr);
+  if (handle != VK_NULL_HANDLE) {
+    vkDestroySwapchainKHR(device, handle, nullptr);
+    return;
+  }
+
+  // headless images are owned by the swapchain
+  for (uint32_t i = 0; i < imageCount; ++i) {
+    vkDestroyImage(device, images[i], nullptr);
+    allocator->Free(imageMemory[i]);
+  }
 }
 
 VulkanBase::PhysicalDeviceProps::PhysicalDeviceProps(
@@ -296,6 +861,9 @@ VulkanBase::PhysicalDeviceProps::PhysicalDeviceProps(
   vkGetPhysicalDeviceQueueFamilyProperties(
     handle, &count, queueFamilyProps.data());
 
+  if (surface == VK_NULL_HANDLE)
+    return;
+
   count = 0;
   vkGetPhysicalDeviceSurfaceFormatsKHR(handle, surface, &count, nullptr);
   surfaceFormats.resize(count);
@@ -324,6 +892,9 @@ VulkanBase::PhysicalDeviceProps::GetGrahicsQueueFamiliyIdx()
 uint32_t
 VulkanBase::PhysicalDeviceProps::GetPresentQueueFamiliyIdx()
 {
+  if (surface == VK_NULL_HANDLE)
+    return -1;
+
   for (uint32_t idx = 0; idx < queueFamilyProps.size(); ++idx) {
     if (queueFamilyProps[idx].queueCount == 0)
       continue;
@@ -1,20 +1,26 @@
 #pragma once
 
 // clang-format off
-#include <vulkan\vulkan.h>
-#include <GLFW\glfw3.h>
+#include <vulkan/vulkan.h>
+#include <GLFW/glfw3.h>
 // clang-format on
 
+#include <functional>
 #include <vector>
 
+#include "device_memory_allocator.h"
+
 struct VulkanBase
 {
   struct VulkanWindow
   {
     virtual VkSurfaceKHR CreateSurface(VkInstance instance) = 0;
     virtual VkExtent2D GetExtent() = 0;
+    // blocks until the window received events
+    virtual void WaitEvents() = 0;
   };
 
+  // nullptr when rendering headless into offscreen images
   VulkanWindow* window = nullptr;
 
   VkInstance instance = VK_NULL_HANDLE;
@@ -52,10 +58,18 @@ struct VulkanBase
   PhysicalDeviceProps physicalDeviceProps = {};
   VkQueue queue = VK_NULL_HANDLE;
   VkCommandPool cmdPool = VK_NULL_HANDLE;
+  DeviceMemoryAllocator* memoryAllocator = nullptr;
+
+  // shared by all pipelines, loaded from PIPELINE_CACHE_FILE when it was
+  // written for the same device and driver and saved back on destruction
+  VkPipelineCache pipelineCache = VK_NULL_HANDLE;
 
+  // in headless mode there is no surface and the swapchain only owns
+  // offscreen color images, handle stays VK_NULL_HANDLE
   struct Swapchain
   {
     VkDevice device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* allocator = nullptr;
     VkSwapchainKHR handle = VK_NULL_HANDLE;
     VkSurfaceFormatKHR surfaceFormat = {};
     VkPresentModeKHR presentMode = {};
@@ -63,10 +77,16 @@ struct VulkanBase
     uint32_t imageCount = {};
     std::vector<VkImage> images = {};
     std::vector<VkImageView> imageViews = {};
+    std::vector<DeviceAllocation> imageMemory = {};
 
     Swapchain(VkDevice device,
               PhysicalDeviceProps physicalDeviceProps,
-              VkSurfaceKHR surface);
+              VkSurfaceKHR surface,
+              VkSwapchainKHR oldSwapchain = VK_NULL_HANDLE);
+    Swapchain(VkDevice device,
+              DeviceMemoryAllocator* allocator,
+              VkExtent2D extent,
+              uint32_t imageCount);
 
     Swapchain() = delete;
     Swapchain(const Swapchain&) = delete;
@@ -77,22 +97,102 @@ struct VulkanBase
 
   Swapchain* swapchain = nullptr;
 
-  std::vector<VkCommandBuffer> commandBuffers = {};
-  std::vector<VkFence> fences = {};
+  // set when present reported the swapchain out of date or suboptimal, it
+  // is recreated before the next image is acquired
+  bool swapchainOutOfDate = false;
+
+  // a replaced swapchain stays alive until the frames submitted before its
+  // replacement finished, together with what was deferred to it
+  struct RetiredSwapchain
+  {
+    Swapchain* swapchain;
+    VkFence fence; // signals after everything submitted before retirement
+    std::vector<std::function<void()>> deleters;
+  };
+  std::vector<RetiredSwapchain> retiredSwapchains = {};
+
+  VkExtent2D headlessExtent = {};
+  uint32_t headlessImageIdx = 0;
+
+  // frame serial s is recorded and submitted with the frame slot
+  // s % framesInFlight. the cpu only blocks when it comes back to a slot
+  // whose previous frame the gpu has not finished yet
+  struct Frame
+  {
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE; // unused with the timeline semaphore
+    VkSemaphore imageAvailableSemaphore = VK_NULL_HANDLE;
+    uint32_t imageIdx = 0; // image the frame renders to
+  };
+
+  uint32_t framesInFlight = 2;
+  std::vector<Frame> frames = {};
+  uint64_t frameSerial = 1; // serial of the frame being recorded
+  uint64_t completedFrameSerial = 0;
 
-  VkSemaphore imageAvailableSemaphore = VK_NULL_HANDLE;
-  VkSemaphore renderFinishedSemaphore = VK_NULL_HANDLE;
+  // one per swapchain image, a slot can come around again while the image
+  // it presented last time is still waiting on its semaphore
+  std::vector<VkSemaphore> renderFinishedSemaphores = {};
+
+  // with VK_KHR_timeline_semaphore every submission signals its frame
+  // serial on this semaphore, which replaces the frame fences
+  bool useTimelineSemaphore = false;
+  VkSemaphore frameTimeline = VK_NULL_HANDLE;
+  PFN_vkWaitSemaphoresKHR waitSemaphores = nullptr;
 
   // --------------------------------------------------------------------------
   // --------------------------------------------------------------------------
 
-  VulkanBase(VulkanWindow* window);
+  // the timeline semaphore is used if requested and supported
+  VulkanBase(VulkanWindow* window,
+             uint32_t framesInFlight = 2,
+             bool timelineSemaphore = false);
+  // renders into framesInFlight offscreen images
+  VulkanBase(VkExtent2D extent,
+             uint32_t framesInFlight = 2,
+             bool timelineSemaphore = false);
   ~VulkanBase();
   void Update();
   virtual void OnSwapchainReinitialized() = 0;
 
+  bool IsHeadless() const { return window == nullptr; }
+
+  // layout swapchain images are left in by the last render pass of a frame
+  VkImageLayout GetPresentLayout() const;
+
+  // waits until the current frame slot is free and acquires the image the
+  // frame renders to. in headless mode images are handed out round robin
+  uint32_t AcquireImage();
+  // submits the command buffer of the current frame, presents unless
+  // headless and moves on to the next frame serial
+  void PresentImage(uint32_t imageIdx);
+
+  Frame& GetFrame() { return frames[frameSerial % framesInFlight]; }
+
+  // blocks until the frame with the given serial finished on the gpu
+  void WaitForFrame(uint64_t serial);
+
+  // copies a rendered headless image into pixels, tightly packed rows in
+  // the swapchain format. waits for the frames submitted so far
+  void ReadbackImage(uint32_t imageIdx, std::vector<uint8_t>& pixels);
+
+  // runs deleter once the frames in flight at the last swapchain
+  // recreation finished, for objects that frames might still use. only
+  // valid from OnSwapchainReinitialized
+  void DeferDestroy(std::function<void()> deleter);
+
+  // destroys retired swapchains whose frames finished, or all of them
+  // after waiting when wait is set
+  void ReleaseRetiredSwapchains(bool wait);
+
 private:
+  // blocks while the window is minimized, its surface has no extent to
+  // create a swapchain with then
   void ReinitSwapchain();
+  Swapchain* CreateSwapchain(VkSwapchainKHR oldSwapchain = VK_NULL_HANDLE);
+
+  void CreatePipelineCache();
+  void SavePipelineCache();
 
   void CreateSwapchainIndependentResources();
   void DestroySwapchainIndependentResources();
@@ -1,10 +1,12 @@
 #ifndef VK_UTILS_H_
 #define VK_UTILS_H_
 
+#include <cstring> // memcpy
 #include <initializer_list>
-#include <memory> // memcpy
-#include <vulkan\vulkan.h>
+#include <vector>
+#include <vulkan/vulkan.h>
 
+#include "device_memory_allocator.h"
 #include "vk_init.h"
 
 #define BREAK                                                                  \
@@ -27,7 +29,8 @@
 inline VkPipeline
 vkuCreateGraphicsPipeline(
   VkDevice device,
-  std::initializer_list<VkPipelineShaderStageCreateInfo> stages,
+  VkPipelineCache pipelineCache,
+  const std::vector<VkPipelineShaderStageCreateInfo>& stages,
   VkPipelineVertexInputStateCreateInfo vertexInputState,
   VkPipelineInputAssemblyStateCreateInfo inputAssemblyState,
   VkPipelineTessellationStateCreateInfo tessellationState,
@@ -45,7 +48,7 @@ vkuCreateGraphicsPipeline(
 {
   auto graphicsPipelineCreateInfo =
     vkiGraphicsPipelineCreateInfo(static_cast<uint32_t>(stages.size()),
-                                  stages.begin(),
+                                  stages.data(),
                                   &vertexInputState,
                                   &inputAssemblyState,
                                   &tessellationState,
@@ -63,7 +66,7 @@ vkuCreateGraphicsPipeline(
 
   VkPipeline pipeline = VK_NULL_HANDLE;
   VkResult result = vkCreateGraphicsPipelines(
-    device, VK_NULL_HANDLE, 1, &graphicsPipelineCreateInfo, nullptr, &pipeline);
+    device, pipelineCache, 1, &graphicsPipelineCreateInfo, nullptr, &pipeline);
   return pipeline;
 }
 
@@ -280,31 +283,30 @@ vkuAllocateMemory(VkDevice device,
   return handle;
 }
 
-inline VkDeviceMemory
+// images are expected to use optimal tiling
+inline DeviceAllocation
 vkuAllocateImageMemory(VkDevice device,
-                       VkPhysicalDeviceMemoryProperties memProps,
+                       DeviceMemoryAllocator* allocator,
                        VkImage image,
+                       VkMemoryPropertyFlags propertyFlags,
                        bool bind)
 {
   VkMemoryRequirements memoryRequirements;
   vkGetImageMemoryRequirements(device, image, &memoryRequirements);
 
-  VkDeviceMemory deviceMemory = vkuAllocateMemory(
-    device,
-    memoryRequirements.size,
-    findMemoryTypeIdx(
-      memoryRequirements, memProps, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT));
+  DeviceAllocation allocation =
+    allocator->Allocate(memoryRequirements, propertyFlags, false);
 
   if (bind) {
-    vkBindImageMemory(device, image, deviceMemory, 0);
+    vkBindImageMemory(device, image, allocation.memory, allocation.offset);
   }
 
-  return deviceMemory;
+  return allocation;
 }
 
-inline VkDeviceMemory
+inline DeviceAllocation
 vkuAllocateBufferMemory(VkDevice device,
-                        VkPhysicalDeviceMemoryProperties memProps,
+                        DeviceMemoryAllocator* allocator,
                         VkBuffer buffer,
                         VkMemoryPropertyFlags propertyFlags,
                         bool bind)
@@ -312,15 +314,13 @@ vkuAllocateBufferMemory(VkDevice device,
   VkMemoryRequirements memoryRequirements;
   vkGetBufferMemoryRequirements(device, buffer, &memoryRequirements);
 
-  VkDeviceMemory deviceMemory = vkuAllocateMemory(
-    device,
-    memoryRequirements.size,
-    findMemoryTypeIdx(memoryRequirements, memProps, propertyFlags));
+  DeviceAllocation allocation =
+    allocator->Allocate(memoryRequirements, propertyFlags, true);
 
   if (bind)
-    vkBindBufferMemory(device, buffer, deviceMemory, 0);
+    vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset);
 
-  return deviceMemory;
+  return allocation;
 }
 
 inline void
@@ -358,126 +358,4 @@ vkuBeginCmdBuffer(VkCommandBuffer commandBuffer,
   vkBeginCommandBuffer(commandBuffer, &info);
 }
 
-inline void
-vkuTransferImageData(VkDevice device,
-                     VkPhysicalDeviceMemoryProperties memProps,
-                     VkCommandPool cmdPool,
-                     VkQueue graphicsQueue,
-                     VkImage image,
-                     VkFormat format,
-                     VkExtent3D extent,
-                     VkImageLayout oldLayout,
-                     VkImageLayout newLayout,
-                     VkDeviceSize size,
-                     void* data)
-{
-  VkBuffer stagingBuffer = vkuCreateBuffer(device,
-                                           size,
-                                           VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                                           VK_SHARING_MODE_EXCLUSIVE,
-                                           {});
-
-  VkDeviceMemory stagingBufferMemory = vkuAllocateBufferMemory(
-    device,
-    memProps,
-    stagingBuffer,
-    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-    true);
-
-  vkuTransferData(device, stagingBufferMemory, 0, size, data);
-
-  VkCommandBuffer cmdBuffer =
-    vkuAllocateCmdBuffer(device, cmdPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
-
-  vkuBeginCmdBuffer(cmdBuffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
-
-  VkImageSubresourceRange imageSubresourceRange =
-    vkiImageSubresourceRange(vkuGetImageAspectFlags(format), 0, 1, 0, 1);
-
-  vkuTransitionLayout(cmdBuffer,
-                      image,
-                      imageSubresourceRange,
-                      oldLayout,
-                      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-
-  auto bufferCopyRegion = vkiBufferImageCopy(
-    0,
-    0,
-    0,
-    vkiImageSubresourceLayers(vkuGetImageAspectFlags(format), 0, 0, 1),
-    {},
-    extent);
-
-  vkCmdCopyBufferToImage(cmdBuffer,
-                         stagingBuffer,
-                         image,
-                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                         1,
-                         &bufferCopyRegion);
-
-  vkuTransitionLayout(cmdBuffer,
-                      image,
-                      imageSubresourceRange,
-                      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                      newLayout);
-
-  vkEndCommandBuffer(cmdBuffer);
-
-  VkFence fence = vkuCreateFence(device);
-  auto submitInfo =
-    vkiSubmitInfo(0, nullptr, nullptr, 1, &cmdBuffer, 0, nullptr);
-
-  vkQueueSubmit(graphicsQueue, 1, &submitInfo, fence);
-  vkWaitForFences(device, 1, &fence, true, (uint64_t)-1);
-  vkFreeCommandBuffers(device, cmdPool, 1, &cmdBuffer);
-  vkDestroyFence(device, fence, nullptr);
-  vkDestroyBuffer(device, stagingBuffer, nullptr);
-  vkFreeMemory(device, stagingBufferMemory, nullptr);
-}
-
-inline void
-vkuTransferBufferData(VkDevice device,
-                      VkPhysicalDeviceMemoryProperties memProps,
-                      VkCommandPool cmdPool,
-                      VkQueue graphicsQueue,
-                      VkBuffer buffer,
-                      VkDeviceSize offset,
-                      VkDeviceSize size,
-                      void* data)
-{
-  VkBuffer stagingBuffer = vkuCreateBuffer(device,
-                                           size,
-                                           VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
-                                             VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                                           VK_SHARING_MODE_EXCLUSIVE,
-                                           {});
-
-  VkDeviceMemory stagingBufferMemory = vkuAllocateBufferMemory(
-    device,
-    memProps,
-    stagingBuffer,
-    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-    true);
-
-  vkuTransferData(device, stagingBufferMemory, 0, size, data);
-
-  VkCommandBuffer cmdBuffer =
-    vkuAllocateCmdBuffer(device, cmdPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
-
-  vkuBeginCmdBuffer(cmdBuffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
-
-  VkBufferCopy copyRegion = { 0, offset, size };
-  vkCmdCopyBuffer(cmdBuffer, stagingBuffer, buffer, 1, &copyRegion);
-  vkEndCommandBuffer(cmdBuffer);
-
-  VkFence fence = vkuCreateFence(device);
-  auto submitInfo =
-    vkiSubmitInfo(0, nullptr, nullptr, 1, &cmdBuffer, 0, nullptr);
-  vkQueueSubmit(graphicsQueue, 1, &submitInfo, fence);
-  vkWaitForFences(device, 1, &fence, true, (uint64_t)-1);
-  vkFreeCommandBuffers(device, cmdPool, 1, &cmdBuffer);
-  vkDestroyFence(device, fence, nullptr);
-  vkDestroyBuffer(device, stagingBuffer, nullptr);
-  vkFreeMemory(device, stagingBufferMemory, nullptr);
-}
 #endif
@@ -101,6 +101,12 @@ Window::GetExtent()
            static_cast<uint32_t>(windowSize.height) };
 }
 
+void
+Window::WaitEvents()
+{
+  glfwWaitEvents();
+}
+
 VkSurfaceKHR
 Window::CreateSurface(VkInstance instance)
 {
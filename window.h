@@ -1,8 +1,8 @@
 #pragma once
 
 // clang-format off
-#include <vulkan\vulkan_core.h>
-#include <GLFW\glfw3.h>
+#include <vulkan/vulkan_core.h>
+#include <GLFW/glfw3.h>
 // clang-format on
 
 #include "vk_base.h"
@@ -15,6 +15,7 @@ struct Window : VulkanBase::VulkanWindow
   void Update();
 
   VkExtent2D GetExtent();
+  void WaitEvents();
   VkSurfaceKHR CreateSurface(VkInstance instance);
 
   struct KeyInput